@@ -17,6 +17,8 @@ typedef struct
 int start_client(client_info client_datas);
 void print_usage(char const* name);
 void *clients(void *info);
+void* wait_for_exit_signal(void* signals);
+void report_round_trip_times(void);
 int close_socket(int* socket);
 int set_reuse(int* socket);
 int connect_to_server(const char *port, const char *ip);
@@ -0,0 +1,159 @@
+#ifndef COMP8005_ASSN2_FRAMING_H
+#define COMP8005_ASSN2_FRAMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Server side of the echo protocol: the client sends frames made up of a 4 byte size followed by that many
+ * bytes of payload, the server echoes each payload back, and a zero size ends the conversation.
+ *
+ * A framer_t tracks one connection's position in that exchange with an explicit state and offsets, so the
+ * event-driven servers can stop and resume it at any byte boundary. The servers own the sockets: they read
+ * into the buffer the framer asks for, call framer_parse, send whatever framer_pending returns and report
+ * back with framer_sent.
+ *
+ * A framer_t is kept to FRAMER_SIZE bytes so that a server can fit it and a few flags of its own into a
+ * single cache line per connection; offsets into the read-ahead buffer are 16 bits for the same reason.
+ */
+#define FRAME_READ_AHEAD_SIZE 8192 // Bytes of client data buffered per read; must fit in a uint16_t
+#define FRAMER_SIZE           56
+#define FRAME_OUT_MSG         UINT16_MAX // out_pos when the echo is msg rather than part of rbuf
+
+typedef enum
+{
+    FRAME_READ_HEADER,  // hdr_have bytes of the next size have been read
+    FRAME_READ_BODY,    // body_have of msg_size bytes have been assembled in msg
+    FRAME_WRITE_BODY,   // [sent, out_len) of the echo at out_pos still has to be sent
+    FRAME_BYPASS_BODY,  // The caller is echoing the last bypass_left bytes of the body itself (e.g. with splice)
+    FRAME_DONE          // The client sent the terminating zero size
+} frame_state;
+
+// Results of framer_parse
+enum
+{
+    FRAMES_NEED_DATA,
+    FRAMES_ECHO,
+    FRAMES_FINISHED,
+    FRAMES_ERROR
+};
+
+typedef struct
+{
+    char* msg;            // Assembles a message that spans reads
+    char* rbuf;           // Read-ahead buffer, FRAME_READ_AHEAD_SIZE bytes
+    ssize_t transferred;  // Bytes read from the client, including bypassed ones
+    uint32_t msg_size;
+    uint32_t body_have;   // Bytes of the current message body read so far
+    uint32_t out_len;
+    uint32_t sent;        // Bytes of the current echo already sent
+    uint32_t bypass_left; // Bytes of the bypassed body still to be read from the socket
+    uint32_t messages;    // Messages whose echo has been started
+    uint16_t rbuf_len;    // Bytes in rbuf
+    uint16_t rbuf_pos;    // Bytes of rbuf already parsed
+    uint16_t out_pos;     // Where in rbuf the echo being sent starts, or FRAME_OUT_MSG
+    uint8_t state;        // A frame_state
+    uint8_t hdr_have;     // Bytes of the current size header read so far
+} framer_t;
+
+/**
+ * Sets up a framer for a new connection.
+ *
+ * @param framer The framer.
+ * @return 0 on success, or -1 if out of memory.
+ */
+int framer_init(framer_t* framer);
+
+/**
+ * Releases a framer's buffers and resets it.
+ *
+ * @param framer The framer.
+ */
+void framer_free(framer_t* framer);
+
+/**
+ * Gives the framer back a read-ahead buffer if framer_release took it, without touching its position in the
+ * conversation.
+ *
+ * @param framer The framer.
+ * @return 0 on success, or -1 if out of memory.
+ */
+int framer_acquire(framer_t* framer);
+
+/**
+ * Returns the framer's buffers to the pool if it's between messages with nothing buffered, so that an idle
+ * connection holds no buffers at all. framer_acquire has to be called before the framer is used again.
+ *
+ * @param framer The framer.
+ */
+void framer_release(framer_t* framer);
+
+/**
+ * Parses as many frames as possible out of the read-ahead buffer. The payloads of frames that are entirely
+ * buffered are packed together in place so that they can all be echoed with a single send; a frame that
+ * spans reads is assembled in msg instead.
+ *
+ * @param framer     The framer, which must not be in FRAME_WRITE_BODY or FRAME_BYPASS_BODY.
+ * @param bypass_min The body size from which bodies are handed over to the caller after their buffered part,
+ *                   or 0 for never.
+ * @return FRAMES_ECHO if there is an echo to send, FRAMES_NEED_DATA once the buffer has been used up,
+ *         FRAMES_FINISHED if the client sent the terminating zero size, or FRAMES_ERROR if out of memory.
+ */
+int framer_parse(framer_t* framer, uint32_t bypass_min);
+
+/**
+ * Gets the part of the echo that hasn't been sent yet.
+ *
+ * @param framer The framer, which must be in FRAME_WRITE_BODY.
+ * @param len    Set to the number of bytes left to send.
+ * @return The first byte left to send.
+ */
+char const* framer_pending(framer_t const* framer, size_t* len);
+
+/**
+ * Gets the buffer for the next read once everything buffered has been parsed: usually the read-ahead
+ * buffer, but the rest of a large body goes straight into msg.
+ *
+ * @param framer The framer.
+ * @param len    Set to the number of bytes that may be read.
+ * @return Where to read to.
+ */
+char* framer_read_dest(framer_t* framer, size_t* len);
+
+/**
+ * Records a read into the buffer from framer_read_dest.
+ *
+ * @param framer The framer.
+ * @param dest   The buffer that was read into.
+ * @param len    The number of bytes read.
+ */
+void framer_read_done(framer_t* framer, char const* dest, size_t len);
+
+/**
+ * Reads whatever the socket holds into the buffer from framer_read_dest.
+ *
+ * @param framer  The framer.
+ * @param sock    The client's socket.
+ * @param drained Set if the read came up short, i.e. the socket has nothing more for now.
+ * @return The number of bytes read, 0 if the client hung up, or -1 on failure (including EWOULDBLOCK).
+ */
+ssize_t framer_recv(framer_t* framer, int sock, int* drained);
+
+/**
+ * Records part of the echo as sent, moving on from FRAME_WRITE_BODY once all of it has been.
+ *
+ * @param framer The framer.
+ * @param len    The number of bytes sent.
+ */
+void framer_sent(framer_t* framer, size_t len);
+
+/**
+ * Records part of a bypassed body as read by the caller, going back to FRAME_READ_HEADER once all of it has been.
+ *
+ * @param framer The framer.
+ * @param len    The number of bytes read.
+ */
+void framer_bypassed(framer_t* framer, size_t len);
+
+#endif //COMP8005_ASSN2_FRAMING_H
@@ -18,6 +18,28 @@
  */
 ssize_t send_data(int sock, const void* buffer, size_t bytes_to_send);
 
+/**
+ * Like send_data, but sends with MSG_ZEROCOPY so that the kernel transmits straight from the buffer rather
+ * than copying it. The buffer must not be modified until read_zerocopy_completions has counted as many
+ * completions as there were sends.
+ *
+ * @param sock          The socket on which to send the data; SO_ZEROCOPY must be set on it.
+ * @param buffer        The data to send.
+ * @param bytes_to_send The size of the data to send.
+ * @param num_sends     Incremented for every zerocopy send made.
+ * @return -1 on error (except EWOULDBLOCK), or the number of bytes successfully sent.
+ */
+ssize_t send_data_zerocopy(int sock, const void* buffer, size_t bytes_to_send, uint32_t* num_sends);
+
+/**
+ * Reads any MSG_ZEROCOPY completion notifications from the socket's error queue without blocking.
+ *
+ * @param sock          The socket on which zerocopy sends were made.
+ * @param num_completed Incremented by the number of sends the kernel has finished with.
+ * @return 0 on success, or -1 on failure.
+ */
+int read_zerocopy_completions(int sock, uint32_t* num_completed);
+
 /**
  * Attempts to send all bytes in buffer. If the send produces EWOULDBLOCK, returns the number of bytes
  * successfully sent. Otherwise, returns -1.
@@ -5,6 +5,8 @@
 #ifndef COMP8005_ASSN2_ACCEPTOR_H
 #define COMP8005_ASSN2_ACCEPTOR_H
 
+#include <stddef.h>
+#include <sys/time.h>
 #include "client.h"
 
 typedef struct
@@ -12,10 +14,29 @@ typedef struct
     struct addrinfo* info;
     unsigned short port;
     int sock;
+    int client_flags;           // Extra accept4 flags for accepted sockets (SOCK_NONBLOCK for the event-driven servers)
+
+    // Accept stats; only touched by the thread accepting on this acceptor
+    size_t accepted;
+    size_t accept_calls;        // accept4 calls, including the ones that found the backlog empty
+    struct timeval first_accept;
+    struct timeval last_accept;
 } acceptor_t;
 
 /**
- * Attempts to accept a client using the given acceptor.
+ * Creates a socket bound to the given port and starts listening on it.
+ *
+ * @param acceptor   The acceptor to initialise.
+ * @param port       The port on which to listen.
+ * @param reuse_port Non-zero to set SO_REUSEPORT, so that several acceptors can share the port and the kernel
+ *                   balances incoming connections between them.
+ * @return 0 on success, -1 on failure (an error message will have been printed already).
+ */
+int acceptor_open(acceptor_t* acceptor, unsigned short port, int reuse_port);
+
+/**
+ * Attempts to accept a client using the given acceptor. The client's socket is close-on-exec and has the
+ * acceptor's client_flags applied.
  *
  * @param acceptor The acceptor containing a socket on which to accept a client.
  * @param out      A client structure that will hold the new client's information on success.
@@ -23,6 +44,39 @@ typedef struct
  */
 int accept_client(acceptor_t* acceptor, client_t* out);
 
+/**
+ * Puts the listening socket in non-blocking mode, for servers that multiplex it or use accept_client_wait.
+ *
+ * @param acceptor The acceptor.
+ * @return 0 on success, -1 on failure (an error message will have been printed already).
+ */
+int acceptor_set_nonblocking(acceptor_t* acceptor);
+
+/**
+ * Accepts a client, waiting for one if there are none yet. The wait ends early when done is set.
+ *
+ * @param acceptor The acceptor, whose listening socket must be non-blocking.
+ * @param out      A client structure that will hold the new client's information on success.
+ * @return 0 on success, -1 on failure or shutdown.
+ */
+int accept_client_wait(acceptor_t* acceptor, client_t* out);
+
+/**
+ * Adds another acceptor's accept stats to this one's, e.g. to total up several SO_REUSEPORT listeners.
+ *
+ * @param into The acceptor whose stats will be updated.
+ * @param from The acceptor whose stats will be added.
+ */
+void acceptor_merge_stats(acceptor_t* into, acceptor_t const* from);
+
+/**
+ * Prints the accept rate and the number of system calls made per accepted client.
+ *
+ * @param acceptor    The acceptor whose stats will be printed.
+ * @param setup_calls The system calls the server made to set up accepted clients, other than accept4 itself.
+ */
+void acceptor_print_stats(acceptor_t const* acceptor, size_t setup_calls);
+
 /**
  * Cleans up the acceptor's addrinfo and socket.
  *
@@ -6,7 +6,80 @@
 #define COMP8005_ASSN2_DONE_H
 
 #include <stdatomic.h>
+#include <stddef.h>
 
 extern atomic_int done;
 
+/**
+ * Shutdown and reconfiguration are delivered to the event loops through two file descriptors that every loop
+ * watches for readability alongside its sockets, so that no loop needs a timeout (or an interrupted system
+ * call) to notice them:
+ *
+ * - a signalfd for SIGINT, SIGQUIT and SIGHUP, which done_init blocks in every thread, and
+ * - an eventfd that done_set makes readable for good, so that every loop wakes up, not just the one that
+ *   read the signal.
+ *
+ * A loop that finds either of them readable calls done_check and stops once it returns non-zero. SIGHUP
+ * reconfigures the server from whichever loop reads it (it toggles server_options.verbose) and doesn't stop
+ * anything.
+ */
+
+/**
+ * Blocks SIGINT, SIGQUIT and SIGHUP and opens the signalfd and eventfd. Must be called before any other thread is
+ * started, so that they all inherit the signal mask.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed).
+ */
+int done_init(void);
+
+/**
+ * Returns the signalfd.
+ *
+ * @return The fd, or -1 before done_init.
+ */
+int done_signal_fd(void);
+
+/**
+ * Returns the eventfd that becomes readable when done is set.
+ *
+ * @return The fd, or -1 before done_init.
+ */
+int done_event_fd(void);
+
+/**
+ * Sets done and wakes every loop watching the eventfd. Safe to call from any thread, any number of times.
+ */
+void done_set(void);
+
+/**
+ * Takes any pending signals off the signalfd, setting done for SIGINT or SIGQUIT and reconfiguring for
+ * SIGHUP.
+ *
+ * @return Non-zero once done is set.
+ */
+int done_check(void);
+
+/**
+ * Waits for one of a few descriptors to become readable, or for shutdown, for threads that would otherwise
+ * block in a single system call (e.g. accept).
+ *
+ * @param fds     The descriptors.
+ * @param num_fds How many there are; at most DONE_WAIT_MAX_FDS.
+ * @return 0 once any of them is readable, or -1 once done is set or on failure.
+ */
+#define DONE_WAIT_MAX_FDS 4
+int done_wait(int const* fds, size_t num_fds);
+
+/**
+ * Reports whether shutdown was caused by SIGINT or SIGQUIT rather than an error.
+ *
+ * @return Non-zero if it was.
+ */
+int done_by_signal(void);
+
+/**
+ * Closes the signalfd and eventfd. The signals stay blocked.
+ */
+void done_cleanup(void);
+
 #endif //COMP8005_ASSN2_DONE_H
@@ -0,0 +1,28 @@
+#ifndef COMP8005_ASSN2_METRICS_H
+#define COMP8005_ASSN2_METRICS_H
+
+/**
+ * Serves the live server stats in the Prometheus text format from a side thread, so that a running server
+ * can be scraped (or just queried with curl or nc) without the servers themselves doing any extra work: the
+ * thread reads the same atomic counters and histograms as the console reporter.
+ *
+ * Each connection gets the current metrics and is closed. Requests that start with "GET " get an HTTP
+ * response; anything else gets the bare metrics text.
+ */
+
+/**
+ * Starts listening for metrics requests and starts the thread that answers them.
+ *
+ * @param address A TCP port, which is bound on the loopback address only, or the path of a Unix domain
+ *                socket, which is replaced if it already exists.
+ * @return 0 on success, or -1 on failure (an error message will have been printed).
+ */
+int metrics_start(char const* address);
+
+/**
+ * Stops the metrics thread, if it's running, and closes (and, for a Unix domain socket, removes) the
+ * listener.
+ */
+void metrics_stop(void);
+
+#endif //COMP8005_ASSN2_METRICS_H
@@ -0,0 +1,65 @@
+#ifndef COMP8005_ASSN2_OPTIONS_H
+#define COMP8005_ASSN2_OPTIONS_H
+
+#include <stdatomic.h>
+
+// Connection deadlines in seconds; see the timeout fields below
+#define DEFAULT_IDLE_TIMEOUT   300
+#define DEFAULT_HEADER_TIMEOUT 30
+#define DEFAULT_WRITE_TIMEOUT  60
+
+// Thread server pool bounds, and seconds a worker may sit idle before it exits while above the minimum
+#define DEFAULT_MIN_WORKERS 200
+#define DEFAULT_MAX_WORKERS 10000
+#define DEFAULT_WORKER_IDLE 30
+
+/**
+ * Tunables set from the command line in main() and read by the server implementations when they start.
+ */
+typedef struct
+{
+    // Number of event loops for the multi-reactor epoll server; 0 means one per online CPU
+    unsigned int num_reactors;
+
+    // Set SO_REUSEPORT on listeners; epoll-mt then gives every reactor its own listening socket
+    int reuse_port;
+
+    // Messages of at least this many bytes are echoed by the epoll servers with splice() through a pipe
+    // rather than copied through user space; 0 disables splicing
+    unsigned int splice_threshold;
+
+    // Echoes of at least this many bytes are sent by the epoll servers with MSG_ZEROCOPY; 0 disables zerocopy
+    unsigned int zerocopy_threshold;
+
+    // Most clients the epoll and select servers accept per wakeup before going back to serving existing
+    // clients; 0 means each server's default
+    unsigned int accept_budget;
+
+    // Print a line for every finished connection as well as the periodic stats; SIGHUP toggles it while the
+    // server runs
+    atomic_int verbose;
+
+    // Seconds between the stats reporter's lines; 0 turns the reporter off
+    unsigned int report_interval;
+
+    // Port or Unix domain socket path on which to serve Prometheus metrics; NULL for none
+    char const* metrics_address;
+
+    // Seconds after which the epoll and select servers close a connection that has received nothing (idle),
+    // has taken that long to send a message's size header once it started it (header), or has had an echo
+    // stuck behind a full send buffer (write); 0 disables that deadline
+    unsigned int idle_timeout;
+    unsigned int header_timeout;
+    unsigned int write_timeout;
+
+    // The thread server keeps at least min_workers threads, starts more as clients arrive up to max_workers,
+    // and lets a thread above the minimum exit once it has been idle for worker_idle seconds (0 for never).
+    // Clients that arrive while all max_workers threads are busy wait in a bounded backlog
+    unsigned int min_workers;
+    unsigned int max_workers;
+    unsigned int worker_idle;
+} server_options_t;
+
+extern server_options_t server_options;
+
+#endif //COMP8005_ASSN2_OPTIONS_H
@@ -0,0 +1,42 @@
+#ifndef COMP8005_ASSN2_PLACEMENT_H
+#define COMP8005_ASSN2_PLACEMENT_H
+
+#include <stddef.h>
+
+/**
+ * Pins the servers' threads to the CPUs given with --cpus. Thread slots are handed out in order, wrapping
+ * around the list: the accepting thread and the first reactor or worker get the first CPU, reactor or worker
+ * i gets CPU i modulo the length of the list.
+ *
+ * A pinned thread also asks for its memory to come from its own NUMA node. Each thread is pinned before it
+ * allocates its buffers and before it first touches its part of the connection table, so those pages are
+ * placed on the node the thread runs on.
+ */
+
+/**
+ * Parses a CPU list such as "0-3,8,10-11" and remembers it for placement_pin.
+ *
+ * @param list The list.
+ * @return 0 on success, or -1 if the list is malformed or names a CPU that the process can't run on (an
+ *         error message will have been printed).
+ */
+int placement_parse(char const* list);
+
+/**
+ * Returns whether --cpus was given.
+ *
+ * @return Non-zero if threads are to be pinned.
+ */
+int placement_enabled(void);
+
+/**
+ * Pins the calling thread to the CPU for the given slot and makes it allocate memory from that CPU's node.
+ * Does nothing unless --cpus was given.
+ *
+ * @param role  What the thread is, for the line printed about it, or NULL to not print one.
+ * @param slot  The thread's index among the threads being placed.
+ * @return The CPU, or -1 if the thread wasn't pinned.
+ */
+int placement_pin(char const* role, size_t slot);
+
+#endif //COMP8005_ASSN2_PLACEMENT_H
@@ -15,6 +15,8 @@ typedef struct server_t server_t;
 extern server_t* thread_server;
 extern server_t* select_server;
 extern server_t* epoll_server;
+extern server_t* epoll_mt_server;
+extern server_t* uring_server;
 
 struct server_t
 {
@@ -50,10 +52,6 @@ struct server_t
      */
     void (*cleanup)(server_t* server);
 
-    // Summary stats
-    size_t max_concurrent;
-    size_t total_served;
-
     // Data private to the server implementation (reference to thread pool, queue for receiving new clients, etc.)
     void* private;
 };
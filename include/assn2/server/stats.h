@@ -0,0 +1,196 @@
+#ifndef COMP8005_ASSN2_STATS_H
+#define COMP8005_ASSN2_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "histogram.h"
+
+/**
+ * Live server stats. The servers count connections and bytes as they go and record each finished
+ * connection's transfer time; a reporter thread prints one line per interval with the connection and byte
+ * rates, the number of active connections and the transfer time percentiles over that interval, instead of
+ * the servers printing a line for every connection.
+ *
+ * Each message's service time, from the read that completed it to the send that finished its echo, is
+ * recorded too. Its percentiles and those of the transfer times are printed when the server exits, and the
+ * service times are saved with histogram_write.
+ *
+ * The counting functions are safe to call from any thread and never block. Every count goes to the calling
+ * thread's own block of counters (see counters.h), so the servers' threads never write to a shared cache
+ * line to count; the totals are only added up when something reads them. stats_read gives the metrics
+ * endpoint and the exit summary the same numbers.
+ */
+#define STATS_DEFAULT_INTERVAL 1 // Seconds
+
+// Operations that can come back with EWOULDBLOCK
+typedef enum
+{
+    STATS_OP_RECV,
+    STATS_OP_SEND,   // Includes sends that only took part of the data
+    STATS_OP_ACCEPT,
+    STATS_NUM_OPS
+} stats_op;
+
+// Deadlines after which the event-driven servers close a connection
+typedef enum
+{
+    STATS_TIMEOUT_IDLE,   // Nothing received, between messages or part way through a body
+    STATS_TIMEOUT_HEADER, // A message's size header started but not finished
+    STATS_TIMEOUT_WRITE,  // An echo stuck behind a full send buffer
+    STATS_NUM_TIMEOUTS
+} stats_timeout;
+
+/**
+ * Running totals; see stats_read.
+ */
+typedef struct
+{
+    size_t opened;
+    size_t closed;
+    size_t rejected;
+    uint64_t bytes_received;
+    uint64_t bytes_sent;
+    uint64_t messages;
+    uint64_t would_block[STATS_NUM_OPS];
+    uint64_t setup_calls;
+    size_t max_concurrent;
+    uint64_t timed_out[STATS_NUM_TIMEOUTS];
+} stats_counters;
+
+/**
+ * Tracks a connection's messages for their service times. Zeroed for a new connection.
+ */
+typedef struct
+{
+    struct timeval ready; // When the last read from the client finished
+    uint32_t timed;       // The connection's messages whose service time has been recorded
+} stats_timer;
+
+/**
+ * Counts a newly accepted connection.
+ */
+void stats_connection_opened(void);
+
+/**
+ * Raises the high-water mark of concurrent connections. Only meaningful from the thread that keeps the
+ * count, since the largest value any one thread saw is what gets reported.
+ *
+ * @param connected The number of connections open now.
+ */
+void stats_connections_peak(size_t connected);
+
+/**
+ * Adds up the connections opened and not yet closed, for servers without a count of their own. This reads
+ * every thread's counters, so it's more expensive than the other functions here.
+ *
+ * @return The number of open connections.
+ */
+size_t stats_active_connections(void);
+
+/**
+ * Counts system calls spent setting up an accepted client, other than accept4 itself.
+ *
+ * @param count The number of system calls.
+ */
+void stats_setup_calls(size_t count);
+
+/**
+ * Counts a connection that has been closed.
+ *
+ * @param transfer_time Microseconds spent serving the connection, or -1 if it failed and shouldn't count
+ *                      towards the transfer times.
+ */
+void stats_connection_closed(time_t transfer_time);
+
+/**
+ * Counts an accepted connection that the server couldn't take on and closed straight away. It isn't counted
+ * as opened or closed.
+ */
+void stats_connection_rejected(void);
+
+/**
+ * Counts bytes received from a client.
+ *
+ * @param count The number of bytes.
+ */
+void stats_bytes_received(size_t count);
+
+/**
+ * Counts bytes sent to a client.
+ *
+ * @param count The number of bytes.
+ */
+void stats_bytes_sent(size_t count);
+
+/**
+ * Counts an operation that would have blocked.
+ *
+ * @param op The operation.
+ */
+void stats_would_block(stats_op op);
+
+/**
+ * Counts a connection closed because it missed a deadline. The connection still has to be counted as closed
+ * with stats_connection_closed.
+ *
+ * @param kind The deadline it missed.
+ */
+void stats_timed_out(stats_timeout kind);
+
+/**
+ * Notes that a read from the client has just finished; any message it completes is ready to be echoed.
+ *
+ * @param timer The connection's timer.
+ */
+void stats_message_ready(stats_timer* timer);
+
+/**
+ * Records the service time of every message echoed since the last call, once the connection has no echo
+ * left in progress.
+ *
+ * @param timer    The connection's timer.
+ * @param messages The number of messages the connection has echoed in all.
+ */
+void stats_messages_echoed(stats_timer* timer, uint32_t messages);
+
+/**
+ * Gives the calling thread histograms of its own to record service and transfer times in, so that an event
+ * loop doesn't write to the same buckets as every other loop for each message it echoes. They're merged
+ * with the rest whenever the stats are read. Meant for threads that last as long as the server; threads
+ * that don't call this share one set.
+ */
+void stats_thread_histograms(void);
+
+/**
+ * Starts the reporter thread.
+ *
+ * @param interval Seconds between reports, or 0 to not start the reporter.
+ * @return 0 on success, or -1 on failure (an error message will have been printed).
+ */
+int stats_start(unsigned int interval);
+
+/**
+ * Wakes up the reporter thread, if it's running, and waits for it to exit.
+ */
+void stats_stop(void);
+
+/**
+ * Reads the running totals and copies the service and transfer time histograms.
+ *
+ * @param counters      Set to the totals.
+ * @param service_copy  Set to the service times, in microseconds, unless NULL.
+ * @param transfer_copy Set to the transfer times, in microseconds, unless NULL.
+ */
+void stats_read(stats_counters* counters, histogram_t* service_copy, histogram_t* transfer_copy);
+
+/**
+ * Prints the service and transfer time percentiles for the whole run and saves the service times.
+ *
+ * @param name The file in which to save the service time histogram.
+ */
+void stats_print_totals(char const* name);
+
+#endif //COMP8005_ASSN2_STATS_H
@@ -0,0 +1,51 @@
+#ifndef COMP8005_ASSN2_BUFFER_POOL_H
+#define COMP8005_ASSN2_BUFFER_POOL_H
+
+#include <stddef.h>
+
+/**
+ * Message buffers are handed out in power-of-two size classes from BUFFER_POOL_MIN_SIZE up to
+ * BUFFER_POOL_MAX_SIZE. Freed buffers go to a cache owned by the freeing thread, which hands them
+ * straight back out without locking; caches that grow too large spill half of a class to a global
+ * depot, and threads with an empty cache refill from it. Buffers larger than BUFFER_POOL_MAX_SIZE
+ * come from malloc and go straight back to free.
+ *
+ * Any thread may free a buffer allocated by any other thread.
+ */
+#define BUFFER_POOL_MIN_SIZE 256
+#define BUFFER_POOL_MAX_SIZE (1024 * 1024)
+
+/**
+ * Allocates a buffer of at least the given size.
+ *
+ * @param size The number of usable bytes required.
+ * @return The buffer, or NULL if out of memory.
+ */
+void* buffer_pool_alloc(size_t size);
+
+/**
+ * Makes sure that a buffer can hold at least size bytes, replacing it with a larger one if it can't.
+ * The contents are not preserved when the buffer is replaced.
+ *
+ * @param buf  The buffer to check, or NULL to allocate a new one.
+ * @param size The number of usable bytes required.
+ * @return A buffer of at least size bytes, or NULL if out of memory (in which case buf is untouched).
+ */
+void* buffer_pool_reserve(void* buf, size_t size);
+
+/**
+ * Returns the number of usable bytes in a buffer, which may be more than was asked for.
+ *
+ * @param buf A buffer from buffer_pool_alloc or buffer_pool_reserve.
+ * @return The buffer's capacity.
+ */
+size_t buffer_pool_capacity(void const* buf);
+
+/**
+ * Returns a buffer to the pool.
+ *
+ * @param buf A buffer from buffer_pool_alloc or buffer_pool_reserve, or NULL.
+ */
+void buffer_pool_free(void* buf);
+
+#endif //COMP8005_ASSN2_BUFFER_POOL_H
@@ -0,0 +1,70 @@
+#ifndef COMP8005_ASSN2_COUNTERS_H
+#define COMP8005_ASSN2_COUNTERS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Sharded statistics counters. Each thread that counts something gets its own cache-line-aligned block of
+ * counters, which only it ever writes, so counting is a plain load and store with no locked instruction
+ * and no cache line bouncing between cores. Readers add up (or take the largest of) every thread's value
+ * when they need a total.
+ *
+ * A thread's block is given up when it exits and taken over by the next thread that counts, keeping its
+ * values, so totals never go backwards. A group can be declared statically with COUNTERS_INITIALIZER and
+ * needs no setup or cleanup.
+ */
+#define COUNTERS_MAX        32 // Counters per group
+#define COUNTERS_MAX_GROUPS 4  // Groups a thread can count in
+#define COUNTERS_CACHE_LINE 64
+
+typedef struct counter_block counter_block;
+
+typedef struct
+{
+    size_t num_counters;
+    _Atomic(counter_block*) blocks;              // Push-only list of every thread's block
+    atomic_uint_fast64_t shared[COUNTERS_MAX];   // For threads that couldn't get a block of their own
+} counters_t;
+
+#define COUNTERS_INITIALIZER(num_counters) { (num_counters), NULL, { 0 } }
+
+/**
+ * Adds to one of the calling thread's counters. A total read after another thread has seen the effects
+ * of the call includes it.
+ *
+ * @param counters The group.
+ * @param counter  The counter's index, less than num_counters.
+ * @param value    The amount to add.
+ */
+void counters_add(counters_t* counters, size_t counter, uint64_t value);
+
+/**
+ * Raises one of the calling thread's counters to the given value if it's lower, for high-water marks.
+ *
+ * @param counters The group.
+ * @param counter  The counter's index, less than num_counters.
+ * @param value    The new value.
+ */
+void counters_raise(counters_t* counters, size_t counter, uint64_t value);
+
+/**
+ * Adds up a counter across every thread.
+ *
+ * @param counters The group.
+ * @param counter  The counter's index.
+ * @return The total.
+ */
+uint64_t counters_sum(counters_t* counters, size_t counter);
+
+/**
+ * Finds the largest value of a counter across every thread.
+ *
+ * @param counters The group.
+ * @param counter  The counter's index.
+ * @return The largest value.
+ */
+uint64_t counters_max(counters_t* counters, size_t counter);
+
+#endif //COMP8005_ASSN2_COUNTERS_H
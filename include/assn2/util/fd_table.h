@@ -0,0 +1,75 @@
+#ifndef COMP8005_ASSN2_FD_TABLE_H
+#define COMP8005_ASSN2_FD_TABLE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * A pointer per file descriptor, for finding a connection from the fd an event came in on. The table is
+ * two levels: a directory, sized for the largest fd up front, of pages of FD_TABLE_PAGE_SIZE entries that
+ * are allocated the first time an fd in their range is stored. Pages are never moved or freed until the
+ * table is destroyed, so a lookup is two loads with no locking, and memory follows the highest fds in use
+ * rather than the fd limit.
+ *
+ * Any thread may look up entries while another stores to them; only adding a page takes the lock. Storing
+ * to and reading the same entry from different threads needs ordering from elsewhere (e.g. storing a
+ * connection before registering its fd with epoll).
+ */
+#define FD_TABLE_PAGE_BITS 12
+#define FD_TABLE_PAGE_SIZE (1 << FD_TABLE_PAGE_BITS) // Entries per page
+#define FD_TABLE_MAX_FDS   (1 << 20) // The kernel's default fs.nr_open, for an unlimited RLIMIT_NOFILE
+
+typedef struct
+{
+    pthread_mutex_t lock;  // Held while adding a page
+    size_t max_fds;        // Every fd stored must be below this
+    size_t num_pages;
+    _Atomic(void**)* pages;
+} fd_table_t;
+
+/**
+ * Sets up an empty table. Only the directory is allocated.
+ *
+ * @param table   The table.
+ * @param max_fds One more than the largest fd to be stored, typically the RLIMIT_NOFILE soft limit.
+ * @return 0 on success, or -1 if out of memory.
+ */
+int fd_table_init(fd_table_t* table, size_t max_fds);
+
+/**
+ * Gets the max_fds that covers every fd the process can open: the RLIMIT_NOFILE soft limit, capped at
+ * FD_TABLE_MAX_FDS. Only the pages for fds actually in use get allocated, so this costs a pointer per
+ * FD_TABLE_PAGE_SIZE fds.
+ *
+ * @return The number of fds.
+ */
+size_t fd_table_open_limit(void);
+
+/**
+ * Looks up an fd.
+ *
+ * @param table The table.
+ * @param fd    The fd.
+ * @return The fd's entry, or NULL if nothing has been stored for it or it's out of range.
+ */
+void* fd_table_get(fd_table_t* table, int fd);
+
+/**
+ * Stores an fd's entry, allocating its page if need be.
+ *
+ * @param table The table.
+ * @param fd    The fd.
+ * @param value The entry, or NULL to clear it.
+ * @return 0 on success, or -1 if the fd is out of range or its page couldn't be allocated.
+ */
+int fd_table_set(fd_table_t* table, int fd, void* value);
+
+/**
+ * Frees the pages and the directory. The entries themselves are left alone.
+ *
+ * @param table The table.
+ */
+void fd_table_destroy(fd_table_t* table);
+
+#endif //COMP8005_ASSN2_FD_TABLE_H
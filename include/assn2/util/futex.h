@@ -0,0 +1,54 @@
+#ifndef COMP8005_ASSN2_FUTEX_H
+#define COMP8005_ASSN2_FUTEX_H
+
+#include <stdatomic.h>
+
+/**
+ * Thin wrappers around the futex system call, for threads that spin briefly on an atomic int and then sleep
+ * on it. Waiters and wakers only ever meet in the kernel when someone is actually asleep, so an uncontended
+ * hand-off costs no system calls at all.
+ *
+ * The futexes are private to the process.
+ */
+
+/**
+ * Hints to the CPU that the caller is spinning, so that a sibling hyperthread gets the core's resources
+ * and leaving the loop doesn't cost a memory-order mis-speculation.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define futex_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define futex_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define futex_cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+/**
+ * Sleeps while the word still holds the expected value. May return early for no reason (a signal, or a
+ * wake meant for an earlier wait), so callers re-check their condition in a loop.
+ *
+ * @param word     The word.
+ * @param expected The value that means "keep waiting".
+ */
+void futex_wait(atomic_int* word, int expected);
+
+/**
+ * Like futex_wait, but gives up once the timeout has passed.
+ *
+ * @param word       The word.
+ * @param expected   The value that means "keep waiting".
+ * @param timeout_ms The longest to sleep, in milliseconds.
+ * @return 0 if the wait ended for any other reason, or -1 if it timed out.
+ */
+int futex_wait_for(atomic_int* word, int expected, unsigned int timeout_ms);
+
+/**
+ * Wakes threads sleeping on the word. Change the word before calling it, or a waiter that hasn't gone to
+ * sleep yet will.
+ *
+ * @param word  The word.
+ * @param count The most threads to wake; INT_MAX for all of them.
+ */
+void futex_wake(atomic_int* word, int count);
+
+#endif //COMP8005_ASSN2_FUTEX_H
@@ -0,0 +1,149 @@
+#ifndef COMP8005_ASSN2_HISTOGRAM_H
+#define COMP8005_ASSN2_HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Log-linear histogram of non-negative integer values (e.g. microseconds). Values below
+ * 2 * HISTOGRAM_SUB_BUCKETS each get their own bucket; above that, every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS equal buckets, so a value is known to within 1/HISTOGRAM_SUB_BUCKETS of itself
+ * across the whole 64 bit range with a fixed, small number of buckets.
+ *
+ * Recording is a relaxed atomic add (plus a compare-and-swap on a new maximum), so any number of threads may
+ * record into the same histogram. Readers work on a copy taken with histogram_snapshot.
+ *
+ * Histograms are saved as text: a HISTOGRAM_FILE_MAGIC line, a "max <value>" line, then a "<value> <count>"
+ * line for each bucket in use, where the value is the smallest one the bucket holds. Reading a file adds its
+ * counts to a histogram, so the files from any number of processes can be merged by reading them all into
+ * the same one.
+ */
+#define HISTOGRAM_FILE_MAGIC "C8005HIST 1"
+#define HISTOGRAM_SUB_BUCKET_BITS 6
+#define HISTOGRAM_SUB_BUCKETS     (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS         ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct
+{
+    atomic_uint_fast64_t counts[HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t max; // Exact, unlike the percentiles
+} histogram_t;
+
+/**
+ * Records a value.
+ *
+ * @param histogram The histogram.
+ * @param value     The value to record.
+ */
+void histogram_record(histogram_t* histogram, uint64_t value);
+
+/**
+ * Records the same value several times.
+ *
+ * @param histogram The histogram.
+ * @param value     The value to record.
+ * @param count     The number of times to record it.
+ */
+void histogram_record_n(histogram_t* histogram, uint64_t value, uint64_t count);
+
+/**
+ * Adds the counts from one histogram to another.
+ *
+ * @param histogram The histogram to add to.
+ * @param other     The histogram to add, which shouldn't be recorded into concurrently.
+ */
+void histogram_add(histogram_t* histogram, histogram_t const* other);
+
+/**
+ * Copies a histogram that may still be being recorded into.
+ *
+ * @param histogram The histogram to copy.
+ * @param out       Set to the copy.
+ */
+void histogram_snapshot(histogram_t const* histogram, histogram_t* out);
+
+/**
+ * Removes an earlier snapshot's counts from a later one, leaving just the values recorded in between. The
+ * maximum is left alone, since there's no telling whether it was recorded before or after the earlier one.
+ *
+ * @param histogram A snapshot.
+ * @param earlier   An earlier snapshot of the same histogram.
+ */
+void histogram_subtract(histogram_t* histogram, histogram_t const* earlier);
+
+/**
+ * Gets the number of values recorded.
+ *
+ * @param histogram The histogram, which shouldn't be recorded into concurrently.
+ * @return The number of values.
+ */
+uint64_t histogram_count(histogram_t const* histogram);
+
+/**
+ * Gets the value below which the given percentage of the recorded values fall.
+ *
+ * @param histogram  The histogram, which shouldn't be recorded into concurrently.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The largest value that falls in the same bucket as the percentile, capped at the maximum, or 0 if the
+ *         histogram is empty.
+ */
+uint64_t histogram_percentile(histogram_t const* histogram, double percentile);
+
+/**
+ * Gets the number of values recorded that are less than the given one. Exact when the value is a power of two
+ * (or below 2 * HISTOGRAM_SUB_BUCKETS); otherwise the bucket holding it is counted as being above it.
+ *
+ * @param histogram The histogram, which shouldn't be recorded into concurrently.
+ * @param value     The value to count up to.
+ * @return The number of values below it.
+ */
+uint64_t histogram_count_below(histogram_t const* histogram, uint64_t value);
+
+/**
+ * Estimates the sum of the values recorded, taking each one to be in the middle of its bucket.
+ *
+ * @param histogram The histogram, which shouldn't be recorded into concurrently.
+ * @return The estimated sum.
+ */
+double histogram_sum(histogram_t const* histogram);
+
+/**
+ * Gets the largest value recorded.
+ *
+ * @param histogram The histogram.
+ * @return The largest value, or 0 if the histogram is empty.
+ */
+uint64_t histogram_max(histogram_t const* histogram);
+
+/**
+ * Prints a line with the number of values recorded and their p50, p90, p99, p99.9 and maximum.
+ *
+ * @param histogram The histogram, which shouldn't be recorded into concurrently.
+ * @param out       Where to print the line.
+ * @param name      What the values are, e.g. "Round trip time".
+ * @param unit      The values' unit, e.g. "us".
+ */
+void histogram_print(histogram_t const* histogram, FILE* out, char const* name, char const* unit);
+
+/**
+ * Saves a histogram in the text format described above.
+ *
+ * @param histogram The histogram, which shouldn't be recorded into concurrently.
+ * @param name      The name of the file, which is created or truncated.
+ * @return 0 on success, or -1 on failure (an error message will have been printed).
+ */
+int histogram_write(histogram_t const* histogram, char const* name);
+
+/**
+ * Reads a saved histogram, adding its counts to the given one.
+ *
+ * @param histogram The histogram to add to.
+ * @param name      The name of the file.
+ * @return 0 on success, or -1 if the file couldn't be read or isn't a saved histogram (an error message will
+ *         have been printed). The histogram is left untouched on failure.
+ */
+int histogram_read(histogram_t* histogram, char const* name);
+
+#endif //COMP8005_ASSN2_HISTOGRAM_H
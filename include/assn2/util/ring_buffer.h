@@ -2,39 +2,91 @@
 #include <stdatomic.h>
 #include <stddef.h>
 
+/**
+ * A bounded multi-producer, multi-consumer queue (Dmitry Vyukov's design). Every slot carries a sequence number
+ * that says whose turn it is: a producer may fill the slot for position pos once its sequence is pos, and a
+ * consumer may empty it once it's pos + 1. Claiming a position is a CAS on head or tail, but an item only
+ * becomes visible when its slot's sequence moves on, so a consumer can never see a half-written item.
+ *
+ * The try_ calls never block. put and get spin briefly and then sleep on a futex until the queue changes;
+ * each side only makes a system call to wake the other when someone is actually asleep.
+ */
 typedef struct
 {
-    atomic_size_t head;
-    atomic_size_t tail;
-    atomic_int reader_guard; // Makes sure that the reader doesn't read partially-written data if it catches up to writers
-
-    void* mem; // Should probably be a static fixed-size buffer since it will never be freed
-    size_t size;
+    // Only written by ring_buffer_init
+    unsigned char* slots;
+    size_t slot_size;
     size_t elem_size;
+    size_t mask;
+    size_t size;
+
+    _Alignas(64) atomic_size_t head; // Next position to read
+    _Alignas(64) atomic_size_t tail; // Next position to write
+
+    // Event counts and sleeper counts for the blocking calls
+    _Alignas(64) atomic_int put_event;
+    atomic_int get_waiters;
+    atomic_int get_event;
+    atomic_int put_waiters;
 } ring_buffer_t;
 
 /**
- * Tries to add an element to the buffer. This will block if the buffer is full.
+ * Initialises the buffer, allocating its slots.
  *
  * @param buf       The buffer to initialise.
- * @param mem       The memory to use as a ciruclar buffer.
- * @param size      The number of elem_size elements that the buffer can hold.
+ * @param size      The number of elements that the buffer must hold; rounded up to a power of two of at least
+ *                  2, which is left in buf->size.
  * @param elem_size The size of each element in the buffer.
+ * @return 0 on success, or -1 if out of memory.
+ */
+int ring_buffer_init(ring_buffer_t* buf, size_t size, size_t elem_size);
+
+/**
+ * Frees the buffer's slots. No thread may be using it.
+ *
+ * @param buf The buffer.
+ */
+void ring_buffer_free(ring_buffer_t* buf);
+
+/**
+ * Adds an element to the buffer if there's room.
+ *
+ * @param buf  The buffer to which to add the item.
+ * @param item A pointer to the item (which will be copied by value) to add to the buffer.
+ * @return 0 on success, or -1 if the buffer is full.
  */
-void ring_buffer_init(ring_buffer_t* buf, void* mem, size_t size, size_t elem_size);
+int ring_buffer_try_put(ring_buffer_t* buf, void const* item);
 
 /**
- * Tries to add an element to the buffer. This will block if the buffer is full.
+ * Adds an element to the buffer, blocking while it's full.
  *
  * @param buf  The buffer to which to add the item.
  * @param item A pointer to the item (which will be copied by value) to add to the buffer.
  */
-void ring_buffer_put(ring_buffer_t* buf, void* item);
+void ring_buffer_put(ring_buffer_t* buf, void const* item);
+
+/**
+ * Retrieves the oldest item from the buffer if there is one.
+ *
+ * @param buf The buffer from which to retrieve the item.
+ * @param out Pointer to a variable that will hold the result. Must be >= buf->elem_size.
+ * @return 0 on success, or -1 if the buffer is empty.
+ */
+int ring_buffer_try_get(ring_buffer_t* buf, void* out);
 
 /**
- * Retrieves the next item from the ring buffer. Blocks if there are no items available.
+ * Retrieves the oldest item from the buffer, blocking while it's empty.
  *
  * @param buf The buffer from which to retrieve the item.
  * @param out Pointer to a variable that will hold the result. Must be >= buf->elem_size.
  */
-void ring_buffer_get(ring_buffer_t* buf, void* out);
\ No newline at end of file
+void ring_buffer_get(ring_buffer_t* buf, void* out);
+
+/**
+ * Returns the number of items in the buffer, including any that are still being written or read. Only a
+ * snapshot while other threads are using it.
+ *
+ * @param buf The buffer.
+ * @return The number of items.
+ */
+size_t ring_buffer_count(ring_buffer_t* buf);
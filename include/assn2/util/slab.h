@@ -0,0 +1,101 @@
+#ifndef COMP8005_ASSN2_SLAB_H
+#define COMP8005_ASSN2_SLAB_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Fixed-size records carved out of SLAB_CHUNK_SIZE chunks, for tables of objects that come and go, such as
+ * connections. Every record has a hot part and an optional cold part. A chunk holds all of its hot parts
+ * together at the front and its cold parts after them, so code that only touches hot parts never pulls cold
+ * data into the cache. Chunks are aligned to their size, which lets slab_cold find a record's cold part from
+ * its hot part without either holding a pointer to the other.
+ *
+ * Records never move. Freed records are reused before a new chunk is allocated, and chunks are kept until
+ * the slab is destroyed, so memory use follows the peak number of records.
+ *
+ * Allocating and freeing take a lock, so any thread may free a record allocated by another.
+ */
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+typedef struct slab_chunk slab_chunk;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t hot_size;
+    size_t cold_size;
+    size_t per_chunk;   // Records per chunk
+    size_t cold_offset; // Where a chunk's cold parts start
+    slab_chunk* chunks;
+    void* free_list;    // Free hot parts, linked through their first bytes
+    size_t in_use;
+    size_t peak;
+    size_t num_chunks;
+} slab_t;
+
+/**
+ * Sets up an empty slab.
+ *
+ * @param slab      The slab.
+ * @param hot_size  The size of each record's hot part; at least a pointer, and a multiple of the cache line
+ *                  size if records are to stay on their own lines.
+ * @param cold_size The size of each record's cold part, or 0 for none.
+ * @return 0 on success, or -1 if a chunk couldn't hold a single record.
+ */
+int slab_init(slab_t* slab, size_t hot_size, size_t cold_size);
+
+/**
+ * Allocates a record with both parts zeroed.
+ *
+ * @param slab The slab.
+ * @return The record's hot part, or NULL if out of memory.
+ */
+void* slab_alloc(slab_t* slab);
+
+/**
+ * Finds a record's cold part.
+ *
+ * @param slab The slab the record came from.
+ * @param hot  The record's hot part.
+ * @return The cold part.
+ */
+void* slab_cold(slab_t const* slab, void const* hot);
+
+/**
+ * Returns a record to the slab.
+ *
+ * @param slab The slab the record came from.
+ * @param hot  The record's hot part, or NULL.
+ */
+void slab_free(slab_t* slab, void* hot);
+
+/**
+ * Frees every chunk. Records still in use are freed along with them.
+ *
+ * @param slab The slab.
+ */
+void slab_destroy(slab_t* slab);
+
+/**
+ * Returns the memory each record accounts for, including its share of its chunk's header and slack.
+ *
+ * @param slab The slab.
+ * @return Bytes per record.
+ */
+size_t slab_record_bytes(slab_t const* slab);
+
+/**
+ * Prints the size of the records in one or more slabs of the same layout and, once any have been used,
+ * the most that were in use at once and the memory held for them.
+ *
+ * @param slabs       The slabs.
+ * @param num_slabs   The number of slabs.
+ * @param out         Where to print.
+ * @param name        What the records are.
+ * @param extra_bytes Memory per record held outside the slabs (e.g. in a lookup table), included in the total.
+ */
+void slab_print(slab_t* const* slabs, size_t num_slabs, FILE* out, char const* name, size_t extra_bytes);
+
+#endif //COMP8005_ASSN2_SLAB_H
@@ -0,0 +1,104 @@
+#ifndef COMP8005_ASSN2_TIMER_WHEEL_H
+#define COMP8005_ASSN2_TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hierarchical hashed timer wheel, for deadlines on large numbers of connections. Time is counted in ticks
+ * of TIMER_WHEEL_TICK_MS. The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots each: level 0
+ * has a slot per tick, and each level above it has a slot per full turn of the level below. A timer goes
+ * into the lowest level whose range covers it, and is moved down ("cascaded") when the level below comes
+ * round to its slot. Scheduling and cancelling are O(1), as is each tick, so the cost never depends on how
+ * many timers there are; deadlines beyond the top level's range are clamped to it (about 46 hours).
+ *
+ * Timers are intrusive: the caller embeds a timer_entry in whatever it's timing and gets the entry back when
+ * it expires. A wheel is not thread safe; each event loop keeps its own.
+ */
+#define TIMER_WHEEL_TICK_MS 10
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS  4
+
+typedef struct timer_entry timer_entry;
+
+struct timer_entry
+{
+    timer_entry* next;
+    timer_entry** pprev; // The pointer that points to this entry, or NULL if the timer isn't scheduled
+    uint64_t expires;    // Tick
+    uint8_t level;
+    uint8_t slot;
+};
+
+typedef struct
+{
+    uint64_t now;                                         // The next tick to be run
+    size_t count;                                         // Timers scheduled
+    uint64_t occupied[TIMER_WHEEL_LEVELS];                // Bit i set if slot i of the level is non-empty
+    timer_entry* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+/**
+ * Called for each expired timer, which has already been removed from the wheel, so the callback may free
+ * it or schedule it again.
+ */
+typedef void (*timer_wheel_expired)(timer_entry* entry, void* arg);
+
+/**
+ * Returns the monotonic clock in milliseconds, the time base for the other functions.
+ *
+ * @return The time.
+ */
+uint64_t timer_wheel_clock(void);
+
+/**
+ * Sets up an empty wheel.
+ *
+ * @param wheel The wheel.
+ * @param now   The current time, from timer_wheel_clock.
+ */
+void timer_wheel_init(timer_wheel_t* wheel, uint64_t now);
+
+/**
+ * Schedules a timer, first cancelling it if it's already scheduled. The entry must have been zeroed or
+ * cancelled before it's first scheduled.
+ *
+ * @param wheel   The wheel.
+ * @param entry   The timer.
+ * @param expires When it should expire, in milliseconds; it never expires early, and at most a tick late
+ *                once the wheel is advanced past it.
+ */
+void timer_wheel_schedule(timer_wheel_t* wheel, timer_entry* entry, uint64_t expires);
+
+/**
+ * Cancels a timer. Does nothing if it isn't scheduled.
+ *
+ * @param wheel The wheel.
+ * @param entry The timer.
+ */
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_entry* entry);
+
+/**
+ * Works out how long an event loop can wait before it next has to advance the wheel, from the first
+ * non-empty slot of each level. The answer is exact when the next timer is within a turn of level 0, and
+ * otherwise the time until the timers it's waiting for get cascaded down.
+ *
+ * @param wheel The wheel.
+ * @param now   The current time.
+ * @return Milliseconds to wait, or -1 if there are no timers.
+ */
+int timer_wheel_timeout(timer_wheel_t const* wheel, uint64_t now);
+
+/**
+ * Runs every tick up to the current time, calling back for the timers that expire.
+ *
+ * @param wheel   The wheel.
+ * @param now     The current time.
+ * @param expired The callback.
+ * @param arg     Passed to the callback.
+ * @return The number of timers that expired.
+ */
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now, timer_wheel_expired expired, void* arg);
+
+#endif //COMP8005_ASSN2_TIMER_WHEEL_H
@@ -0,0 +1,81 @@
+#ifndef COMP8005_ASSN2_TRANSFER_LOG_H
+#define COMP8005_ASSN2_TRANSFER_LOG_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+/**
+ * The servers record every finished connection as a fixed-size binary record in a memory-mapped file,
+ * so closing a connection costs a few stores instead of formatting text. The transfers-dump tool turns
+ * the file into the transfer_time,transferred,addr:port CSV offline.
+ *
+ * The file is a transfer_log_header followed by transfer_records in the order their slots were claimed.
+ * Records are written in place and only marked valid once complete, so a file left behind by a crash
+ * may have trailing or interleaved empty slots, which readers skip.
+ */
+#define TRANSFER_LOG_MAGIC   "C8005TRL"
+#define TRANSFER_LOG_VERSION 1
+
+#define TRANSFER_RECORD_VALID 0x1
+
+typedef struct
+{
+    char magic[8];        // TRANSFER_LOG_MAGIC, without the terminator
+    uint32_t version;     // TRANSFER_LOG_VERSION
+    uint32_t record_size; // sizeof(transfer_record)
+} transfer_log_header;
+
+typedef struct
+{
+    int64_t closed_at;     // When the connection was closed, in microseconds since the epoch
+    int64_t transfer_time; // Microseconds spent serving the connection
+    int64_t transferred;   // Bytes received from the client
+    uint32_t messages;     // Messages echoed
+    uint32_t addr;         // Peer IPv4 address, in network byte order
+    uint16_t port;         // Peer port, in host byte order
+    uint16_t flags;        // TRANSFER_RECORD_VALID once the record is complete
+    uint32_t reserved;
+} transfer_record;
+
+/**
+ * Creates (or truncates) the log file and maps it.
+ *
+ * @param name The name of the file.
+ * @return 0 on success, or -1 on failure (an error message will have been printed).
+ */
+int transfer_log_open(char const* name);
+
+/**
+ * Appends a record for a finished connection. Safe to call from any number of threads at once, and never
+ * blocks: the file is extended ahead of the appenders by a thread of its own.
+ *
+ * @param closed_at     When the connection was closed.
+ * @param transfer_time Microseconds spent serving the connection.
+ * @param transferred   Bytes received from the client.
+ * @param messages      Messages echoed.
+ * @param peer          The client's address.
+ * @return 0 on success, or -1 if the record was dropped because the log is full or the file hadn't been
+ *         extended to its slot yet.
+ */
+int transfer_log_append(struct timeval const* closed_at, time_t transfer_time, ssize_t transferred,
+                        uint32_t messages, struct sockaddr_in const* peer);
+
+/**
+ * Gets the number of records written and dropped so far.
+ *
+ * @param written Set to the number of records appended.
+ * @param dropped Set to the number of records dropped.
+ */
+void transfer_log_counts(size_t* written, size_t* dropped);
+
+/**
+ * Unmaps the log and trims the file to the records actually claimed. Must only be called once no other
+ * thread is appending.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+int transfer_log_close(void);
+
+#endif //COMP8005_ASSN2_TRANSFER_LOG_H
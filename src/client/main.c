@@ -22,6 +22,7 @@ Name:			main.c
 #include <getopt.h>
 #include <pthread.h>
 #include <netdb.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdatomic.h>
@@ -34,6 +35,7 @@ Name:			main.c
 #include <errno.h>
 
 #include "client.h"
+#include "histogram.h"
 #include "protocol.h"
 
 #define DEFAULT_PORT "8005"
@@ -43,8 +45,12 @@ Name:			main.c
 #define DEFAULT_MSG_SIZE 1024
 #define NETWORK_BUFFER_SIZE 1024
 #define STACK_SIZE 65536
+#define DEFAULT_HISTOGRAM_FILE "rtt.hist"
 
 static atomic_int thread_count = 0;
+static histogram_t round_trip_times; // Microseconds
+static char const* histogram_file = DEFAULT_HISTOGRAM_FILE;
+static atomic_flag reported = ATOMIC_FLAG_INIT;
 
 
 /*********************************************************************************************
@@ -72,18 +78,21 @@ FUNCTION
 *********************************************************************************************/
 void print_usage(char const* name)
 {
-    printf("usage: %s [-h] [-i ip] [-p port] [-m max] [-t threads]\n", name);
+    printf("usage: %s [-h] [-i ip] [-p port] [-m max] [-t threads] [-H file]\n", name);
     printf("\t-h, --help:               print this help message and exit.\n");
     printf("\t-i, --ip [ip]             the ip on which the server is on.\n");
     printf("\t-p, --port [port]:        the port on which to listen for connections;\n");
     printf("\t-m, --max [max]           the max numbers of requests.\n");
     printf("\t-n, --threads [threads]   the number of threads to create (each thread continuously creates clients).\n");
     printf("\t-s, --msg-size [size]     the size of the message that will be sent each request.\n");
+    printf("\t-H, --histogram [file]    where to save the round trip time histogram on exit; the files\n");
+    printf("\t                          from several clients can be combined with histogram-merge.\n");
     printf("\t                          default port is %s.\n", DEFAULT_PORT);
     printf("\t                          default IP is %s.\n", DEFAULT_IP);
     printf("\t                          default number of threads is %d.\n", DEFAULT_NUMBER_CLIENTS);
     printf("\t                          default number of max requests is %d.\n", DEFAULT_MAXIMUM_REQUESTS);
     printf("\t                          default message size is %d.\n", DEFAULT_MSG_SIZE);
+    printf("\t                          default histogram file is %s.\n", DEFAULT_HISTOGRAM_FILE);
 }
 
 /*********************************************************************************************
@@ -118,7 +127,7 @@ int main(int argc, char** argv)
     //system("ulimit -n 500000");
 
     client_info client_datas;
-    char const* short_opts = "i:p:m:n:t:h";
+    char const* short_opts = "i:p:m:n:t:s:H:h";
     int file_descriptors[2];
     struct option long_opts[] =
     {
@@ -127,6 +136,7 @@ int main(int argc, char** argv)
         {"max",      1, NULL, 'm'},
         {"clients",  1, NULL, 'n'},
         {"msg-size", 1, NULL, 's'},
+        {"histogram", 1, NULL, 'H'},
         {"help",     0, NULL, 'h'},
         {0, 0, 0, 0},
     };
@@ -228,6 +238,9 @@ int main(int argc, char** argv)
                     }
                 }
                 break;
+                case 'H':
+                    histogram_file = optarg;
+                break;
                 case 'h':
                     print_usage(argv[0]);
                     exit(EXIT_SUCCESS);
@@ -315,6 +328,21 @@ int start_client(client_info client_datas)
     pthread_attr_init(&attribute);
     pthread_attr_setstacksize(&attribute, STACK_SIZE);
 
+    // The clients run until they're interrupted, so leave SIGINT and SIGTERM to a thread that reports
+    // the round trip times before exiting. The client threads inherit the blocked mask.
+    static sigset_t exit_signals;
+    sigemptyset(&exit_signals);
+    sigaddset(&exit_signals, SIGINT);
+    sigaddset(&exit_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &exit_signals, NULL);
+
+    pthread_t signal_thread;
+    if (pthread_create(&signal_thread, &attribute, wait_for_exit_signal, &exit_signals) != 0)
+    {
+        perror("pthread_create");
+        return -1;
+    }
+
     for (count = 0; count < thread_count; count++)
     {
         if (pthread_create(threads + count, &attribute, clients, &data[count]) != 0)
@@ -329,9 +357,76 @@ int start_client(client_info client_datas)
 	    void* val;
         pthread_join(threads[count], &val);
     }
+    report_round_trip_times();
     return 1;
 }
 
+/*********************************************************************************************
+FUNCTION
+
+    Name:		wait_for_exit_signal
+
+    Prototype:	void* wait_for_exit_signal(void* signals)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    signals - the blocked signals that end the run.
+
+    Return Values:
+	
+    Description:
+    Waits for one of the signals, then reports the round trip times and exits.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void* wait_for_exit_signal(void* signals)
+{
+    int sig;
+    sigwait((sigset_t*)signals, &sig);
+    report_round_trip_times();
+    exit(EXIT_SUCCESS);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		report_round_trip_times
+
+    Prototype:	void report_round_trip_times(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+	
+    Description:
+    Prints the round trip time percentiles and saves the histogram. Only the first call
+    does anything, since the client threads and the signal thread can both finish the run.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void report_round_trip_times(void)
+{
+    if (atomic_flag_test_and_set(&reported))
+    {
+        return;
+    }
+
+    histogram_print(&round_trip_times, stdout, "Round trip time", "us");
+    fflush(stdout);
+    histogram_write(&round_trip_times, histogram_file);
+}
+
 
 /*********************************************************************************************
 FUNCTION
@@ -413,9 +508,12 @@ void* clients(void* infos)
 
             gettimeofday(&end_time, NULL);
 
+            long round_trip = (end_time.tv_sec * 1000000 + end_time.tv_usec) -
+                              (start_time.tv_sec * 1000000 + start_time.tv_usec);
+            histogram_record(&round_trip_times, round_trip > 0 ? (uint64_t)round_trip : 0);
+
             data_received += bytes_read;
-            request_time += (end_time.tv_sec * 1000000 + end_time.tv_usec) -
-                            (start_time.tv_sec * 1000000 + start_time.tv_usec);
+            request_time += round_trip;
             client_count++;
             usleep(250000);
         }
@@ -0,0 +1,547 @@
+/*********************************************************************************************
+Name:			framing.c
+
+    Required:	framing.h
+                buffer_pool.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    The echo protocol's framing state machine, shared by every event-driven server. Each
+    connection moves from READ_HEADER to READ_BODY to WRITE_BODY and back, keeping its
+    offsets into the header, body and echo as it goes, so resuming after a short read or
+    send never has to work out where in a frame the connection is.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "buffer_pool.h"
+#include "framing.h"
+
+_Static_assert(sizeof(framer_t) == FRAMER_SIZE, "framer_t has outgrown FRAMER_SIZE");
+
+/**
+ * Points the echo at the given bytes, which are either msg or part of rbuf, and moves to FRAME_WRITE_BODY.
+ */
+static int start_echo(framer_t* framer, char const* out, uint32_t len)
+{
+    framer->out_pos = out == framer->msg ? FRAME_OUT_MSG : (uint16_t)(out - framer->rbuf);
+    framer->out_len = len;
+    framer->sent = 0;
+    framer->state = FRAME_WRITE_BODY;
+    return FRAMES_ECHO;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_init
+
+    Prototype:	int framer_init(framer_t* framer)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+
+    Return Values:
+    0 on success, or -1 if out of memory.
+
+    Description:
+    Resets the framer to the start of a connection and allocates its read-ahead buffer.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int framer_init(framer_t* framer)
+{
+    memset(framer, 0, sizeof(*framer));
+    framer->rbuf = buffer_pool_alloc(FRAME_READ_AHEAD_SIZE);
+    if (framer->rbuf == NULL)
+    {
+        perror("buffer_pool_alloc");
+        return -1;
+    }
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_free
+
+    Prototype:	void framer_free(framer_t* framer)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+
+    Return Values:
+
+    Description:
+    Returns the framer's buffers to the pool and zeroes it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void framer_free(framer_t* framer)
+{
+    buffer_pool_free(framer->msg);
+    buffer_pool_free(framer->rbuf);
+    memset(framer, 0, sizeof(*framer));
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_acquire
+
+    Prototype:	int framer_acquire(framer_t* framer)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+
+    Return Values:
+    0 on success, or -1 if out of memory.
+
+    Description:
+    Allocates the read-ahead buffer if the framer doesn't have one. msg is allocated by
+    framer_parse when a message needs it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int framer_acquire(framer_t* framer)
+{
+    if (framer->rbuf != NULL)
+    {
+        return 0;
+    }
+
+    framer->rbuf = buffer_pool_alloc(FRAME_READ_AHEAD_SIZE);
+    if (framer->rbuf == NULL)
+    {
+        perror("buffer_pool_alloc");
+        return -1;
+    }
+    framer->rbuf_pos = 0;
+    framer->rbuf_len = 0;
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_release
+
+    Prototype:	void framer_release(framer_t* framer)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+
+    Return Values:
+
+    Description:
+    Frees msg and rbuf once the framer is waiting for the start of a new message and has
+    parsed everything it read. The pool keeps them in the calling thread's cache, so the
+    next message usually gets them straight back.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void framer_release(framer_t* framer)
+{
+    if (framer->state != FRAME_READ_HEADER || framer->hdr_have != 0 || framer->rbuf_pos != framer->rbuf_len)
+    {
+        return;
+    }
+
+    buffer_pool_free(framer->msg);
+    buffer_pool_free(framer->rbuf);
+    framer->msg = NULL;
+    framer->rbuf = NULL;
+    framer->rbuf_pos = 0;
+    framer->rbuf_len = 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_parse
+
+    Prototype:	int framer_parse(framer_t* framer, uint32_t bypass_min)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    bypass_min - the body size from which bodies are left to the caller, or 0 for never.
+
+    Return Values:
+    FRAMES_ECHO if there is an echo to send, FRAMES_NEED_DATA once the read-ahead buffer has
+    been used up, FRAMES_FINISHED if the client sent the terminating zero size, or
+    FRAMES_ERROR if out of memory.
+
+    Description:
+    Runs the state machine over the unparsed part of the read-ahead buffer. While reading
+    headers, frames that are entirely buffered have their payloads packed together in place
+    and are echoed as one batch; the first frame that isn't is assembled in msg, or, if it is
+    at least bypass_min bytes, has its buffered part echoed and the rest left to the caller.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int framer_parse(framer_t* framer, uint32_t bypass_min)
+{
+    char* batch = NULL;
+    uint32_t batch_len = 0;
+
+    while (1)
+    {
+        char* data = framer->rbuf + framer->rbuf_pos;
+        uint32_t avail = framer->rbuf_len - framer->rbuf_pos;
+
+        switch (framer->state)
+        {
+            case FRAME_READ_HEADER:
+            {
+                if (framer->hdr_have == 0 && avail >= sizeof(framer->msg_size))
+                {
+                    uint32_t size;
+                    memcpy(&size, data, sizeof(size));
+                    if (size != 0 && avail - sizeof(size) >= size)
+                    {
+                        // The whole frame is buffered; pack its payload onto the end of the batch
+                        if (batch == NULL)
+                        {
+                            batch = data + sizeof(size);
+                        }
+                        memmove(batch + batch_len, data + sizeof(size), size);
+                        batch_len += size;
+                        framer->rbuf_pos += sizeof(size) + size;
+                        ++framer->messages;
+                        continue;
+                    }
+                }
+
+                if (batch_len > 0)
+                {
+                    // Echo the batch before starting on a frame that isn't fully buffered
+                    return start_echo(framer, batch, batch_len);
+                }
+
+                uint32_t take = sizeof(framer->msg_size) - framer->hdr_have;
+                take = avail < take ? avail : take;
+                memcpy((unsigned char*)&framer->msg_size + framer->hdr_have, data, take);
+                framer->hdr_have += take;
+                framer->rbuf_pos += take;
+                data += take;
+                avail -= take;
+
+                if (framer->hdr_have < sizeof(framer->msg_size))
+                {
+                    return FRAMES_NEED_DATA;
+                }
+                framer->hdr_have = 0;
+
+                if (framer->msg_size == 0)
+                {
+                    // Client is finished sending data
+                    framer->state = FRAME_DONE;
+                    return FRAMES_FINISHED;
+                }
+                if (bypass_min != 0 && framer->msg_size >= bypass_min)
+                {
+                    // Echo whatever part of the body is already buffered; the caller deals with the rest
+                    take = avail < framer->msg_size ? avail : framer->msg_size;
+                    framer->bypass_left = framer->msg_size - take;
+                    framer->rbuf_pos += take;
+                    ++framer->messages;
+                    return start_echo(framer, data, take);
+                }
+                // Nothing in msg is needed any more, so it's just swapped for a big enough buffer if it's too small
+                char* msg = buffer_pool_reserve(framer->msg, framer->msg_size);
+                if (msg == NULL)
+                {
+                    perror("buffer_pool_reserve");
+                    return FRAMES_ERROR;
+                }
+                framer->msg = msg;
+                framer->body_have = 0;
+                framer->state = FRAME_READ_BODY;
+                continue;
+            }
+            case FRAME_READ_BODY:
+            {
+                uint32_t take = framer->msg_size - framer->body_have;
+                take = avail < take ? avail : take;
+                memcpy(framer->msg + framer->body_have, data, take);
+                framer->body_have += take;
+                framer->rbuf_pos += take;
+
+                if (framer->body_have < framer->msg_size)
+                {
+                    return FRAMES_NEED_DATA;
+                }
+
+                // We've received a full message; echo back to the client
+                ++framer->messages;
+                return start_echo(framer, framer->msg, framer->msg_size);
+            }
+            case FRAME_WRITE_BODY:
+                return FRAMES_ECHO;
+            case FRAME_BYPASS_BODY:
+                return FRAMES_NEED_DATA;
+            default:
+                return FRAMES_FINISHED;
+        }
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_read_dest
+
+    Prototype:	char* framer_read_dest(framer_t* framer, size_t* len)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    len - set to the number of bytes that may be read.
+
+    Return Values:
+    The buffer to read into.
+
+    Description:
+    Empties the read-ahead buffer, which must have been fully parsed, and returns it, unless
+    the rest of the current body is at least a buffer's worth, which is read straight into
+    msg instead.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+char* framer_read_dest(framer_t* framer, size_t* len)
+{
+    framer->rbuf_pos = 0;
+    framer->rbuf_len = 0;
+    if (framer->state == FRAME_READ_BODY && framer->msg_size - framer->body_have >= FRAME_READ_AHEAD_SIZE)
+    {
+        *len = framer->msg_size - framer->body_have;
+        return framer->msg + framer->body_have;
+    }
+
+    *len = FRAME_READ_AHEAD_SIZE;
+    return framer->rbuf;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_read_done
+
+    Prototype:	void framer_read_done(framer_t* framer, char const* dest, size_t len)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    dest - the buffer from framer_read_dest.
+    len - the number of bytes read into it.
+
+    Return Values:
+
+    Description:
+    Counts the bytes as transferred and makes them available to framer_parse.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void framer_read_done(framer_t* framer, char const* dest, size_t len)
+{
+    framer->transferred += len;
+    if (dest == framer->rbuf)
+    {
+        framer->rbuf_len = (uint16_t)len;
+    }
+    else
+    {
+        framer->body_have += (uint32_t)len;
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_recv
+
+    Prototype:	ssize_t framer_recv(framer_t* framer, int sock, int* drained)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    sock - the client's socket.
+    drained - set if fewer bytes were read than there was room for.
+
+    Return Values:
+    The number of bytes read, 0 if the client hung up, or -1 on failure.
+
+    Description:
+    Does a single recv into the buffer from framer_read_dest and records it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+ssize_t framer_recv(framer_t* framer, int sock, int* drained)
+{
+    size_t want;
+    char* dest = framer_read_dest(framer, &want);
+
+    ssize_t bytes_read = recv(sock, dest, want, 0);
+    if (bytes_read > 0)
+    {
+        framer_read_done(framer, dest, (size_t)bytes_read);
+        *drained = (size_t)bytes_read < want;
+    }
+    return bytes_read;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_pending
+
+    Prototype:	char const* framer_pending(framer_t const* framer, size_t* len)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    len - set to the number of bytes left to send.
+
+    Return Values:
+    The first byte of the echo that hasn't been sent.
+
+    Description:
+    Turns out_pos back into a pointer into msg or rbuf.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+char const* framer_pending(framer_t const* framer, size_t* len)
+{
+    char const* out = framer->out_pos == FRAME_OUT_MSG ? framer->msg : framer->rbuf + framer->out_pos;
+    *len = framer->out_len - framer->sent;
+    return out + framer->sent;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_sent
+
+    Prototype:	void framer_sent(framer_t* framer, size_t len)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    len - the number of bytes of the echo sent.
+
+    Return Values:
+
+    Description:
+    Advances the echo. Once it has all been sent, the framer goes back to reading headers, or
+    hands over to the caller if the rest of the body is being bypassed.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void framer_sent(framer_t* framer, size_t len)
+{
+    framer->sent += (uint32_t)len;
+    if (framer->sent == framer->out_len)
+    {
+        framer->state = framer->bypass_left > 0 ? FRAME_BYPASS_BODY : FRAME_READ_HEADER;
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		framer_bypassed
+
+    Prototype:	void framer_bypassed(framer_t* framer, size_t len)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    framer - the framer.
+    len - the number of bytes of the body the caller read.
+
+    Return Values:
+
+    Description:
+    Counts the bytes as transferred and goes back to reading headers once the whole body has
+    been read.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void framer_bypassed(framer_t* framer, size_t len)
+{
+    framer->transferred += len;
+    framer->bypass_left -= (uint32_t)len;
+    if (framer->bypass_left == 0)
+    {
+        framer->state = FRAME_READ_HEADER;
+    }
+}
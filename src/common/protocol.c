@@ -18,8 +18,59 @@ Name:			protocol.c
 #include <string.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <linux/errqueue.h>
 #include "protocol.h"
 
+/**
+ * Attempts to send all bytes in buffer with the given send flags.
+ *
+ * @param sock          The socket on which to send the data.
+ * @param buffer        The data to send.
+ * @param bytes_to_send The size of the data to send.
+ * @param flags         Extra flags for send().
+ * @param num_sends     If not NULL, incremented for every successful send() made with MSG_ZEROCOPY.
+ * @return -1 on error (except EWOULDBLOCK), or the number of bytes successfully sent.
+ */
+static ssize_t send_all(int sock, void const *buffer, size_t bytes_to_send, int flags, uint32_t* num_sends)
+{
+    ssize_t bytes_sent = 0;
+    ssize_t sent_total = 0;
+    size_t bytes_left = bytes_to_send;
+
+    unsigned char const* raw = (unsigned char const*)buffer;
+
+    while (sent_total < bytes_to_send)
+    {
+        // MSG_NOSIGNAL so that a client hanging up mid-echo is an error rather than a fatal SIGPIPE
+        bytes_sent = send(sock, raw + sent_total, bytes_left, MSG_NOSIGNAL | flags);
+        if (bytes_sent == -1)
+        {
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY))
+            {
+                // Out of memory for pinning pages, so copy the rest instead
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+            else if (errno == EWOULDBLOCK)
+            {
+                return sent_total;
+            }
+            else
+            {
+                return -1;
+            }
+        }
+        if (num_sends && (flags & MSG_ZEROCOPY))
+        {
+            ++*num_sends;
+        }
+        sent_total += bytes_sent;
+        bytes_left = bytes_to_send - sent_total;
+    }
+
+    return sent_total;
+}
+
 /*********************************************************************************************
 FUNCTION
 
@@ -47,31 +98,96 @@ FUNCTION
 *********************************************************************************************/
 ssize_t send_data(int sock, void const *buffer, size_t bytes_to_send)
 {
-    ssize_t bytes_sent = 0;
-    ssize_t sent_total = 0;
-    size_t bytes_left = bytes_to_send;
+    return send_all(sock, buffer, bytes_to_send, 0, NULL);
+}
 
-    unsigned char const* raw = (unsigned char const*)buffer;
+/*********************************************************************************************
+FUNCTION
 
-    while (sent_total < bytes_to_send)
+    Name:		send_data_zerocopy
+
+    Prototype:	ssize_t send_data_zerocopy(int sock, void const *buffer, size_t bytes_to_send,
+                                           uint32_t* num_sends)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    sock - socket that is having the data sent on; SO_ZEROCOPY must be set on it.
+	buffer - the buffer, which must not be modified until its completions have been read.
+    bytes_to_send - the bytes to send from the socket.
+    num_sends - incremented for every zerocopy send made, i.e. every completion to wait for.
+
+    Return Values:
+    -1 on error (except EWOULDBLOCK), or the number of bytes successfully sent.
+
+    Description:
+    Sends the data with MSG_ZEROCOPY, so the kernel transmits straight from the buffer's pages
+    instead of copying them. If the kernel runs out of memory for pinning pages (ENOBUFS), the
+    rest of the data is copied as usual.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+ssize_t send_data_zerocopy(int sock, void const *buffer, size_t bytes_to_send, uint32_t* num_sends)
+{
+    return send_all(sock, buffer, bytes_to_send, MSG_ZEROCOPY, num_sends);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		read_zerocopy_completions
+
+    Prototype:	int read_zerocopy_completions(int sock, uint32_t* num_completed)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    sock - socket on which zerocopy sends were made.
+    num_completed - incremented by the number of sends the kernel has finished with.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Drains the socket's error queue of MSG_ZEROCOPY completion notifications without blocking.
+    Each notification covers a contiguous range of sends; once num_completed catches up with
+    the num_sends counted by send_data_zerocopy, the sent buffers can be reused.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int read_zerocopy_completions(int sock, uint32_t* num_completed)
+{
+    while (1)
     {
-        bytes_sent = send(sock, raw + sent_total, bytes_left, 0);
-        if (bytes_sent == -1)
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
         {
-            if (errno == EWOULDBLOCK)
-            {
-                return sent_total;
-            }
-            else
+            return errno == EWOULDBLOCK || errno == EAGAIN ? 0 : -1;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            struct sock_extended_err* err = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
             {
-                return -1;
+                // ee_info and ee_data are the first and last send in the range, inclusive
+                *num_completed += err->ee_data - err->ee_info + 1;
             }
         }
-        sent_total += bytes_sent;
-        bytes_left = bytes_to_send - sent_total;
     }
-
-    return sent_total;
 }
 
 /*********************************************************************************************
@@ -16,16 +16,113 @@ Name:			acceptor.c
 
 *********************************************************************************************/
 
+#define _GNU_SOURCE // accept4
+
 #include <netinet/in.h>
 #include <stdio.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
 
 #include "done.h"
 #include "server.h"
+#include "stats.h"
+#include "timing.h"
+
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		acceptor_open
+
+    Prototype:	int acceptor_open(acceptor_t* acceptor, unsigned short port, int reuse_port)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2017-02-17
+
+    Parameters:
+    acceptor - Struct that will hold the listening socket info.
+    port - port number for the server.
+    reuse_port - Whether to set SO_REUSEPORT so that other sockets can bind the same port.
+
+    Return Values:
+    0 on success, or -1 on failure (an error message will have been printed).
+
+    Description:
+    Creates, binds and listens on a socket for the given port. With reuse_port set, several
+    acceptors (in this process or others) can listen on the same port and the kernel spreads
+    incoming connections between them.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int acceptor_open(acceptor_t* acceptor, unsigned short port, int reuse_port)
+{
+    // Thanks Beej: http://beej.us/guide/bgnet/output/html/singlepage/bgnet.html#bind
+    struct addrinfo hints;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    // TODO: Just pass in the port string from argv instead of this nonsense
+    char buf[6] = {0};
+    snprintf(buf, sizeof(buf), "%hu", port);
+    if (getaddrinfo(NULL, buf, &hints, &acceptor->info) != 0)
+    {
+        perror("getaddrinfo");
+        return -1;
+    }
+
+    acceptor->port = port;
+    acceptor->client_flags = 0;
+    acceptor->accepted = 0;
+    acceptor->accept_calls = 0;
+    acceptor->sock = socket(acceptor->info->ai_family, acceptor->info->ai_socktype, acceptor->info->ai_protocol);
+    if (acceptor->sock < 0)
+    {
+        perror("socket");
+        freeaddrinfo(acceptor->info);
+        return -1;
+    }
+
+    int reuse = 1;
+    if (setsockopt(acceptor->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, (socklen_t)sizeof(reuse)) < 0)
+    {
+        // This isn't a fatal error, so just print the error message and carry on
+        perror("setsockopt");
+    }
+
+    if (reuse_port && setsockopt(acceptor->sock, SOL_SOCKET, SO_REUSEPORT, &reuse, (socklen_t)sizeof(reuse)) < 0)
+    {
+        // This one is fatal, since every other listener on the port will fail to bind
+        perror("setsockopt SO_REUSEPORT");
+        cleanup_acceptor(acceptor);
+        return -1;
+    }
+
+    if (bind(acceptor->sock, acceptor->info->ai_addr, acceptor->info->ai_addrlen) < 0)
+    {
+        perror("bind");
+        cleanup_acceptor(acceptor);
+        return -1;
+    }
+
+    if (listen(acceptor->sock, 256) == -1)
+    {
+        perror("listen");
+        cleanup_acceptor(acceptor);
+        return -1;
+    }
 
+    return 0;
+}
 
 /*********************************************************************************************
 FUNCTION
@@ -45,22 +142,29 @@ FUNCTION
     Return Values:
 	
     Description:
-    This accepts the client socket info.
+    This accepts the client socket info. The socket is created close-on-exec with the
+    acceptor's client_flags already applied, so servers that want non-blocking clients
+    don't need any fcntl calls afterwards.
 
     Revisions:
-	(none)
+	2026-10-17 - Use accept4 and count accepts for acceptor_print_stats.
 
 *********************************************************************************************/
 int accept_client(acceptor_t* acceptor, client_t* out)
 {
     struct sockaddr_in peer;
     socklen_t accepted_len = sizeof(peer);
-    int peer_sock = accept(acceptor->sock, (struct sockaddr*)&peer, &accepted_len);
+    int peer_sock = accept4(acceptor->sock, (struct sockaddr*)&peer, &accepted_len, SOCK_CLOEXEC | acceptor->client_flags);
+    ++acceptor->accept_calls;
     if (peer_sock < 0)
     {
-        if (errno != EWOULDBLOCK && errno != EAGAIN)
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
         {
-            atomic_store(&done, 1);
+            stats_would_block(STATS_OP_ACCEPT);
+        }
+        else
+        {
+            done_set();
 
             if (errno != EINTR)
             {
@@ -72,9 +176,174 @@ int accept_client(acceptor_t* acceptor, client_t* out)
 
     out->peer = peer;
     out->sock = peer_sock;
+
+    gettimeofday(&acceptor->last_accept, NULL);
+    if (acceptor->accepted++ == 0)
+    {
+        acceptor->first_accept = acceptor->last_accept;
+    }
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		acceptor_set_nonblocking
+
+    Prototype:	int acceptor_set_nonblocking(acceptor_t* acceptor)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    acceptor - Struct with socket info.
+
+    Return Values:
+    0 on success, or -1 on failure (an error message will have been printed).
+
+    Description:
+    Puts the listening socket in non-blocking mode. Clients accepted on it are unaffected;
+    they get the acceptor's client_flags.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int acceptor_set_nonblocking(acceptor_t* acceptor)
+{
+    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    {
+        perror("fnctl");
+        return -1;
+    }
     return 0;
 }
 
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_client_wait
+
+    Prototype:	int accept_client_wait(acceptor_t* acceptor, client_t* out)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    acceptor - Struct with socket info; the listener must be non-blocking.
+    out - Struct with client info.
+
+    Return Values:
+    0 on success, or -1 on failure or shutdown.
+
+    Description:
+    Accepts straight away while the backlog has clients in it, and otherwise waits in
+    done_wait, so that a thread that does nothing but accept still stops as soon as done
+    is set.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int accept_client_wait(acceptor_t* acceptor, client_t* out)
+{
+    while (accept_client(acceptor, out) == -1)
+    {
+        if ((errno != EWOULDBLOCK && errno != EAGAIN) || done_wait(&acceptor->sock, 1) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		acceptor_merge_stats
+
+    Prototype:	void acceptor_merge_stats(acceptor_t* into, acceptor_t const* from)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    into - acceptor whose stats are updated.
+    from - acceptor whose stats are added.
+
+    Return Values:
+
+    Description:
+    Totals the counts and widens the first/last accept window to cover both acceptors.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void acceptor_merge_stats(acceptor_t* into, acceptor_t const* from)
+{
+    if (from->accepted != 0)
+    {
+        if (into->accepted == 0 || timercmp(&from->first_accept, &into->first_accept, <))
+        {
+            into->first_accept = from->first_accept;
+        }
+        if (into->accepted == 0 || timercmp(&from->last_accept, &into->last_accept, >))
+        {
+            into->last_accept = from->last_accept;
+        }
+    }
+    into->accepted += from->accepted;
+    into->accept_calls += from->accept_calls;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		acceptor_print_stats
+
+    Prototype:	void acceptor_print_stats(acceptor_t const* acceptor, size_t setup_calls)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    acceptor - acceptor whose stats are printed.
+    setup_calls - system calls the server made to set up accepted clients, besides accept4.
+
+    Return Values:
+
+    Description:
+    Prints the accept rate over the window from the first accept to the last, and the system
+    calls spent per accepted client.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void acceptor_print_stats(acceptor_t const* acceptor, size_t setup_calls)
+{
+    if (acceptor->accepted == 0)
+    {
+        return;
+    }
+
+    time_t window_us = TIME_DIFF(acceptor->first_accept, acceptor->last_accept);
+    double window = window_us / 1e6;
+    double accepted = (double)acceptor->accepted;
+    printf("Accepted %zu clients", acceptor->accepted);
+    if (window > 0)
+    {
+        printf(" at %.0f/s", (accepted - 1) / window);
+    }
+    printf("; %.2f syscalls per accept (%.2f accept4 + %.2f setup)\n",
+           (acceptor->accept_calls + setup_calls) / accepted, acceptor->accept_calls / accepted, setup_calls / accepted);
+}
+
 /*********************************************************************************************
 FUNCTION
 
@@ -0,0 +1,367 @@
+/*********************************************************************************************
+Name:			done.c
+
+    Required:	done.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    The done flag and the descriptors that carry it into the event loops. SIGINT,
+    SIGQUIT and SIGHUP are read from a signalfd rather than caught, so a signal can't
+    land in the middle of a loop's work and there's nothing to do in signal context.
+
+    Revisions:
+    2026-10-17 - SIGHUP reconfigures the server through the same signalfd.
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE // pthread_sigmask under -std=c11
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "done.h"
+#include "options.h"
+
+atomic_int done = 0;
+static atomic_int by_signal = 0;
+static int signal_fd = -1;
+static int event_fd = -1;
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_init
+
+    Prototype:	int done_init(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Both descriptors are non-blocking: several loops may race to read the signalfd, and
+    the eventfd is only ever written.
+
+    Revisions:
+	2026-10-17 - Also blocks SIGHUP.
+
+*********************************************************************************************/
+int done_init(void)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1)
+    {
+        perror("signalfd");
+        return -1;
+    }
+
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd == -1)
+    {
+        perror("eventfd");
+        done_cleanup();
+        return -1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_signal_fd
+
+    Prototype:	int done_signal_fd(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    The signalfd, or -1 before done_init.
+
+    Description:
+    Watched for readability by every event loop.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int done_signal_fd(void)
+{
+    return signal_fd;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_event_fd
+
+    Prototype:	int done_event_fd(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    The eventfd, or -1 before done_init.
+
+    Description:
+    Watched for readability by every event loop.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int done_event_fd(void)
+{
+    return event_fd;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_set
+
+    Prototype:	void done_set(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    The eventfd is never read, so it stays readable and a loop that only gets round to
+    waiting after done is set still returns straight away.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void done_set(void)
+{
+    if (atomic_exchange(&done, 1) == 0 && event_fd != -1)
+    {
+        uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) == -1)
+        {
+            perror("write eventfd");
+        }
+    }
+}
+
+/**
+ * Applies a SIGHUP. Whichever loop read it does this, so it may only touch state that every
+ * thread reads atomically.
+ */
+static void reconfigure(void)
+{
+    int verbose = !atomic_fetch_xor(&server_options.verbose, 1);
+    printf("Caught SIGHUP; verbose logging %s.\n", verbose ? "on" : "off");
+    fflush(stdout);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_check
+
+    Prototype:	int done_check(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    Non-zero once done is set.
+
+    Description:
+    Only one of the loops that wake up for a signal gets to read it; the rest find the
+    signalfd empty and wake again for the eventfd. Every pending signal is read, so a
+    SIGINT queued behind a SIGHUP isn't left for the next wakeup.
+
+    Revisions:
+	2026-10-17 - Reconfigures on SIGHUP instead of treating every signal as shutdown.
+
+*********************************************************************************************/
+int done_check(void)
+{
+    struct signalfd_siginfo info;
+    while (signal_fd != -1 && read(signal_fd, &info, sizeof(info)) == sizeof(info))
+    {
+        if (info.ssi_signo == SIGHUP)
+        {
+            reconfigure();
+        }
+        else
+        {
+            atomic_store(&by_signal, 1);
+            done_set();
+        }
+    }
+
+    return atomic_load(&done);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_wait
+
+    Prototype:	int done_wait(int const* fds, size_t num_fds)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    fds - the descriptors to wait for.
+    num_fds - how many there are.
+
+    Return Values:
+    0 once any of them is readable, or -1 once done is set or on failure.
+
+    Description:
+    Polls the descriptors along with the signalfd and eventfd, with no timeout.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int done_wait(int const* fds, size_t num_fds)
+{
+    struct pollfd pfds[DONE_WAIT_MAX_FDS + 2];
+    pfds[0].fd = signal_fd;
+    pfds[1].fd = event_fd;
+    for (size_t i = 0; i < num_fds && i < DONE_WAIT_MAX_FDS; ++i)
+    {
+        pfds[i + 2].fd = fds[i];
+    }
+    size_t num_pfds = (num_fds < DONE_WAIT_MAX_FDS ? num_fds : DONE_WAIT_MAX_FDS) + 2;
+    for (size_t i = 0; i < num_pfds; ++i)
+    {
+        pfds[i].events = POLLIN;
+    }
+
+    while (!atomic_load(&done))
+    {
+        if (poll(pfds, num_pfds, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            done_set();
+            break;
+        }
+
+        if ((pfds[0].revents | pfds[1].revents) != 0 && done_check())
+        {
+            break;
+        }
+        for (size_t i = 2; i < num_pfds; ++i)
+        {
+            if (pfds[i].revents != 0)
+            {
+                return 0;
+            }
+        }
+    }
+
+    return -1;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_by_signal
+
+    Prototype:	int done_by_signal(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    Non-zero if a SIGINT or SIGQUIT was read.
+
+    Description:
+    Lets serve() tell a clean shutdown from an error.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int done_by_signal(void)
+{
+    return atomic_load(&by_signal);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		done_cleanup
+
+    Prototype:	void done_cleanup(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    Called once every thread that watches the descriptors has stopped.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void done_cleanup(void)
+{
+    if (signal_fd != -1)
+    {
+        close(signal_fd);
+        signal_fd = -1;
+    }
+    if (event_fd != -1)
+    {
+        close(event_fd);
+        event_fd = -1;
+    }
+}
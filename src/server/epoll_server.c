@@ -5,6 +5,7 @@ Name:			epoll_server.c
                 acceptor.h
                 done.h
                 server.h
+                framing.h
                 protocol.h
 
     Developer:	Mat Siwoski/Shane Spoor
@@ -20,6 +21,8 @@ Name:			epoll_server.c
 
 *********************************************************************************************/
 
+#define _GNU_SOURCE // splice, pipe2
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stddef.h>
@@ -27,23 +30,35 @@ Name:			epoll_server.c
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
 
-#include "log.h"
+#include "transfer_log.h"
 #include "timing.h"
 #include "done.h"
+#include "fd_table.h"
 #include "acceptor.h"
+#include "framing.h"
 #include "protocol.h"
 #include "server.h"
-#include "vector.h"
+#include "options.h"
+#include "placement.h"
+#include "slab.h"
+#include "stats.h"
+#include "timer_wheel.h"
 
 
 #define ACCEPT_PER_ITER 100
 #define NUM_EPOLL_EVENTS 98304
 
+#define SPLICE_PIPE_SIZE (1024 * 1024) // Requested capacity of the per-client splice pipe
+
 static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int epoll_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
 static int epoll_server_add_client(server_t* server, client_t client);
 static void epoll_server_cleanup(server_t* epoll_server);
 
@@ -52,188 +67,992 @@ static server_t epoll_server_impl =
     epoll_server_start,
     epoll_server_add_client,
     epoll_server_cleanup,
-    0,
-    0,
+    NULL
+};
+
+static server_t epoll_mt_server_impl =
+{
+    epoll_mt_server_start,
+    epoll_server_add_client,
+    epoll_server_cleanup,
     NULL
 };
 
 server_t* epoll_server = &epoll_server_impl;
+server_t* epoll_mt_server = &epoll_mt_server_impl;
 
+#define REQUEST_SLOT_SIZE 64 // A cache line
+
+/**
+ * The part of a connection that the loop touches on every event.
+ */
 typedef struct
 {
-    ssize_t transferred;
-    time_t transfer_time;
-    uint32_t partial_msg_size; // :(
-    uint32_t msg_size;
-    char* msg;
+    framer_t frame;              // Bodies of at least the splice threshold are bypassed and spliced
+    uint32_t pipe_fill;          // Bytes in the pipe still to be written to the socket
+    unsigned int sending : 1;    // Set while output is still queued, waiting for the socket to be writable
+    unsigned int splicing : 1;   // Set while a body is being echoed through the pipe
+    unsigned int has_pipe : 1;
+    unsigned int zerocopy : 1;   // Set if SO_ZEROCOPY is enabled on the socket
+    unsigned int wrote : 1;      // Set when anything is sent, so a stalled echo's deadline isn't pushed back
 } epoll_server_request;
 
+_Static_assert(sizeof(epoll_server_request) <= REQUEST_SLOT_SIZE, "epoll_server_request must fit in a cache line");
+
+/**
+ * The rest of a connection, kept in the same slab record as its request. Only touched for stats and
+ * deadlines and when splicing or zerocopy are in use.
+ */
 typedef struct
 {
-    fd_set set;
-    int max_fd;
-    client_t client;
-    epoll_server_request request;
-} epoll_server_client;
+    struct sockaddr_in peer;
+    time_t transfer_time;
+    stats_timer timer;
+    timer_entry deadline;        // In the reactor's timer wheel while one of the connection's deadlines is on
+    int sock;
+    uint32_t deadline_messages;  // The message count when the deadline was set
+    uint8_t deadline_kind;       // A stats_timeout
+    int pipefd[2];
+    uint32_t zc_sends;           // MSG_ZEROCOPY sends made
+    uint32_t zc_done;            // MSG_ZEROCOPY sends the kernel has finished with
+} epoll_server_conn;
 
+/**
+ * A single event loop. Each reactor owns an epoll fd and the slice of the connection table made up of
+ * the sockets registered with it; no other reactor touches those slots.
+ */
 typedef struct
 {
     int epfd;
-    vector_t epoll_clients;
-    size_t connected_count;
+    int threaded;             // Whether the reactor runs on its own thread
+    pthread_t thread;
+    server_t* server;
+    acceptor_t* acceptor;     // The listening socket this reactor accepts on, if any
+    acceptor_t own_acceptor;  // Storage for the reactor's own SO_REUSEPORT listener
+    slab_t slab;              // The connections registered with this reactor
+    timer_wheel_t timers;     // The connections' deadlines
+    uint64_t now;             // timer_wheel_clock as of the last wakeup
+    _Atomic(timer_entry*) arriving; // Clients added by another thread, whose deadlines haven't been set yet
+    int wake_fd;              // eventfd written when arriving stops being empty, so the reactor never has to poll it
+} epoll_reactor;
+
+typedef struct
+{
+    fd_table_t requests; // Indexed by socket; fds are unique process-wide, so reactors never share a slot
+    epoll_reactor* reactors;
+    size_t num_reactors;
+    size_t next_reactor;    // Only touched by the accepting thread
+    atomic_size_t open_count; // Clients registered with any reactor; changed once as each opens and closes
 } epoll_server_private;
 
+/**
+ * Updates whether the client is waiting for its socket to become writable, arming or disarming EPOLLOUT
+ * when that changes.
+ *
+ * @param reactor The reactor with which the socket is registered.
+ * @param sock    The client's socket.
+ * @param request The client's request.
+ * @param sending Whether output is queued for the client.
+ * @return 0 on success, or -1 on failure.
+ */
+static int watch_writable(epoll_reactor* reactor, int sock, epoll_server_request* request, int sending)
+{
+    if (sending != request->sending)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET | (sending ? EPOLLOUT : 0);
+        event.data.fd = sock;
+        if (epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, sock, &event) == -1)
+        {
+            perror("epoll_ctl");
+            return -1;
+        }
+        request->sending = sending;
+    }
+
+    return 0;
+}
+
+/**
+ * Sends as much of the current echo as the socket will take. Whatever doesn't fit stays queued on the
+ * request and the socket is armed for EPOLLOUT, so the loop can go back to serving other clients
+ * instead of spinning on a slow reader.
+ *
+ * @param reactor The reactor with which the socket is registered.
+ * @param sock    The client's socket.
+ * @param request The client's request, whose framer holds the echo.
+ * @param conn    The rest of the client's connection.
+ * @return 0 on success, or -1 on failure.
+ */
+static int flush_response(epoll_reactor* reactor, int sock, epoll_server_request* request, epoll_server_conn* conn)
+{
+    framer_t* frame = &request->frame;
+    size_t len;
+    char const* out = framer_pending(frame, &len);
+    ssize_t bytes_sent;
+    if (request->zerocopy && frame->out_len >= server_options.zerocopy_threshold)
+    {
+        bytes_sent = send_data_zerocopy(sock, out, len, &conn->zc_sends);
+    }
+    else
+    {
+        bytes_sent = send_data(sock, out, len);
+    }
+    if (bytes_sent == -1)
+    {
+        return -1;
+    }
+    stats_bytes_sent((size_t)bytes_sent);
+    if ((size_t)bytes_sent < len)
+    {
+        stats_would_block(STATS_OP_SEND);
+    }
+    request->wrote |= bytes_sent > 0;
+    framer_sent(frame, (size_t)bytes_sent);
+    if (frame->state == FRAME_BYPASS_BODY)
+    {
+        request->splicing = 1;
+    }
+    else if (frame->state != FRAME_WRITE_BODY)
+    {
+        stats_messages_echoed(&conn->timer, frame->messages);
+    }
+    return watch_writable(reactor, sock, request, frame->state == FRAME_WRITE_BODY);
+}
+
+/**
+ * Echoes the rest of a large body by splicing it from the socket into the client's pipe and from the
+ * pipe back out to the socket, so the payload never enters user space. Runs until the body is done or
+ * neither direction can make progress; if data is left in the pipe, the socket is armed for EPOLLOUT.
+ *
+ * @param reactor The reactor with which the socket is registered.
+ * @param sock    The client's socket.
+ * @param request The client's request.
+ * @param conn    The rest of the client's connection, which holds the pipe.
+ * @return 0 on success, 1 if the client hung up part way through the body, or -1 on failure.
+ */
+static int splice_body(epoll_reactor* reactor, int sock, epoll_server_request* request, epoll_server_conn* conn)
+{
+    if (!request->has_pipe)
+    {
+        if (pipe2(conn->pipefd, O_NONBLOCK | O_CLOEXEC) == -1)
+        {
+            perror("pipe2");
+            return -1;
+        }
+        request->has_pipe = 1;
+
+        // Best effort: with the default 64K pipe the splices take too many trips to pay off
+        fcntl(conn->pipefd[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    }
+
+    framer_t* frame = &request->frame;
+    int progress = 1;
+    while (progress && (frame->bypass_left > 0 || request->pipe_fill > 0))
+    {
+        progress = 0;
+        if (frame->bypass_left > 0)
+        {
+            ssize_t moved = splice(sock, NULL, conn->pipefd[1], NULL, frame->bypass_left,
+                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (moved == -1 && errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                perror("splice in");
+                return -1;
+            }
+            else if (moved == -1)
+            {
+                stats_would_block(STATS_OP_RECV);
+            }
+            else if (moved == 0)
+            {
+                return 1;
+            }
+            else if (moved > 0)
+            {
+                framer_bypassed(frame, (size_t)moved);
+                stats_bytes_received((size_t)moved);
+                stats_message_ready(&conn->timer);
+                request->pipe_fill += moved;
+                progress = 1;
+            }
+        }
+
+        if (request->pipe_fill > 0)
+        {
+            ssize_t moved = splice(conn->pipefd[0], NULL, sock, NULL, request->pipe_fill,
+                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (moved == -1 && errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                perror("splice out");
+                return -1;
+            }
+            else if (moved == -1)
+            {
+                stats_would_block(STATS_OP_SEND);
+            }
+            else if (moved > 0)
+            {
+                stats_bytes_sent((size_t)moved);
+                request->pipe_fill -= moved;
+                request->wrote = 1;
+                progress = 1;
+            }
+        }
+    }
+
+    request->splicing = frame->bypass_left > 0 || request->pipe_fill > 0;
+    if (!request->splicing)
+    {
+        stats_messages_echoed(&conn->timer, frame->messages);
+    }
+
+    // Anything left in the pipe is only stuck because the socket's send buffer is full
+    return watch_writable(reactor, sock, request, request->pipe_fill > 0) == -1 ? -1 : 0;
+}
+
+/**
+ * Returns how long a connection may wait under one of its deadlines.
+ *
+ * @return Milliseconds, or 0 if the deadline is turned off.
+ */
+static uint64_t deadline_ms(stats_timeout kind)
+{
+    unsigned int seconds = kind == STATS_TIMEOUT_WRITE ? server_options.write_timeout :
+                           kind == STATS_TIMEOUT_HEADER ? server_options.header_timeout :
+                           server_options.idle_timeout;
+    return (uint64_t)seconds * 1000;
+}
+
+/**
+ * Sets the deadline that applies to the client now that it has been served: the write deadline while an
+ * echo is waiting for the socket, the header deadline once a size header has been started, and the idle
+ * deadline otherwise. Each event pushes the idle deadline back and each send the write deadline, but a
+ * header has to be finished within its deadline of starting however slowly it trickles in.
+ *
+ * @param reactor The reactor whose wheel the deadline goes in.
+ * @param request The client's request.
+ * @param conn    The rest of the client's connection.
+ */
+static void set_deadline(epoll_reactor* reactor, epoll_server_request* request, epoll_server_conn* conn)
+{
+    stats_timeout kind = STATS_TIMEOUT_IDLE;
+    int wrote = request->wrote;
+    request->wrote = 0;
+    if (request->sending)
+    {
+        kind = STATS_TIMEOUT_WRITE;
+        if (conn->deadline_kind == kind && !wrote)
+        {
+            // Woken by more data from a client that isn't reading its echo
+            return;
+        }
+    }
+    else if (request->frame.state == FRAME_READ_HEADER && request->frame.hdr_have > 0)
+    {
+        kind = STATS_TIMEOUT_HEADER;
+        if (conn->deadline_kind == kind && conn->deadline_messages == request->frame.messages)
+        {
+            // Still the same header
+            return;
+        }
+    }
+
+    conn->deadline_kind = (uint8_t)kind;
+    conn->deadline_messages = request->frame.messages;
+    uint64_t wait = deadline_ms(kind);
+    if (wait == 0)
+    {
+        timer_wheel_cancel(&reactor->timers, &conn->deadline);
+    }
+    else
+    {
+        timer_wheel_schedule(&reactor->timers, &conn->deadline, reactor->now + wait);
+    }
+}
+
+/**
+ * Removes a client from its reactor and frees everything the connection holds.
+ *
+ * @param reactor The reactor with which the socket is registered.
+ * @param sock    The client's socket.
+ * @param request The client's request.
+ * @param conn    The rest of the client's connection.
+ */
+static void close_client(epoll_reactor* reactor, int sock, epoll_server_request* request, epoll_server_conn* conn)
+{
+    epoll_server_private* private = (epoll_server_private*)reactor->server->private;
+
+    struct epoll_event ev;
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, sock, &ev);
+
+    timer_wheel_cancel(&reactor->timers, &conn->deadline);
+    framer_free(&request->frame);
+    if (request->has_pipe)
+    {
+        close(conn->pipefd[0]);
+        close(conn->pipefd[1]);
+    }
+
+    // Empty the slot before the fd can be handed out again by an accept on another thread
+    fd_table_set(&private->requests, sock, NULL);
+    slab_free(&reactor->slab, request);
+    close(sock);
+    atomic_fetch_sub_explicit(&private->open_count, 1, memory_order_relaxed);
+}
+
+/**
+ * Closes a client that has missed its deadline. Called by the reactor's timer wheel.
+ *
+ * @param entry        The connection's deadline.
+ * @param void_reactor The reactor.
+ */
+static void deadline_expired(timer_entry* entry, void* void_reactor)
+{
+    epoll_reactor* reactor = (epoll_reactor*)void_reactor;
+    epoll_server_private* private = (epoll_server_private*)reactor->server->private;
+    epoll_server_conn* conn = (epoll_server_conn*)((char*)entry - offsetof(epoll_server_conn, deadline));
+    epoll_server_request* request = fd_table_get(&private->requests, conn->sock);
+
+    stats_timed_out((stats_timeout)conn->deadline_kind);
+    stats_connection_closed(-1);
+    if (server_options.verbose)
+    {
+        static char const* kind_names[STATS_NUM_TIMEOUTS] = { "idle", "header", "write" };
+        printf("Timed out (%s); total bytes transferred: %ld; peer: %s:%hu\n", kind_names[conn->deadline_kind],
+               request->frame.transferred, inet_ntoa(conn->peer.sin_addr), ntohs(conn->peer.sin_port));
+    }
+
+    close_client(reactor, conn->sock, request, conn);
+}
+
+/**
+ * Closes a client that the server can't take on, and counts it.
+ *
+ * @param sock The client's socket.
+ */
+static void reject_client(int sock)
+{
+    close(sock);
+    stats_connection_rejected();
+}
+
+/**
+ * Registers a client's socket with the reactor's epoll set, which makes it the reactor's to serve. Must be
+ * called from the reactor's own thread, once the client is in the connection table. If the socket can't be
+ * registered, the client is rejected.
+ *
+ * @param reactor The reactor that will serve the client.
+ * @param request The client's request.
+ * @param conn    The rest of the client's connection.
+ * @return 0 on success, or -1 if the client was rejected.
+ */
+static int register_client(epoll_reactor* reactor, epoll_server_request* request, epoll_server_conn* conn)
+{
+    epoll_server_private* priv = (epoll_server_private*)reactor->server->private;
+    struct epoll_event event;
+
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = conn->sock;
+    stats_setup_calls(1);
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, conn->sock, &event) == -1)
+    {
+        perror("epoll_ctl");
+        timer_wheel_cancel(&reactor->timers, &conn->deadline);
+        fd_table_set(&priv->requests, conn->sock, NULL);
+        slab_free(&reactor->slab, request);
+        reject_client(conn->sock);
+        return -1;
+    }
+
+    // Shared by every reactor, so the peak is exact however many there are
+    stats_connection_opened();
+    stats_connections_peak(atomic_fetch_add_explicit(&priv->open_count, 1, memory_order_relaxed) + 1);
+    return 0;
+}
+
+/**
+ * Registers the clients another thread has handed the reactor since it last woke, and starts their idle
+ * deadlines. Must be called after each wakeup before any events are handled.
+ *
+ * @param reactor The reactor.
+ */
+static void start_arrivals(epoll_reactor* reactor)
+{
+    epoll_server_private* priv = (epoll_server_private*)reactor->server->private;
+    timer_entry* entry = atomic_exchange(&reactor->arriving, NULL);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    while (entry != NULL)
+    {
+        timer_entry* next = entry->next;
+        entry->next = NULL;
+
+        epoll_server_conn* conn = (epoll_server_conn*)((char*)entry - offsetof(epoll_server_conn, deadline));
+        if (register_client(reactor, fd_table_get(&priv->requests, conn->sock), conn) == 0)
+        {
+            // Counted from when the client was accepted rather than from when the reactor woke up
+            uint64_t wait = deadline_ms(STATS_TIMEOUT_IDLE);
+            if (wait != 0)
+            {
+                timer_wheel_schedule(&reactor->timers, entry, entry->expires + wait);
+            }
+        }
+        entry = next;
+    }
+}
+
 /**
  * Handles a client request on the given socket.
  *
- * @param set  The client set for this server, which contains the list of clients and requests.
- * @param sock The socket for the given client.
+ * @param server  The server, which contains the connection table.
+ * @param reactor The reactor with which the socket is registered.
+ * @param sock    The socket for the given client.
  * @return 0 on success, or -1 on failure.
  */
-static int handle_request(server_t* server, int sock)
+static int handle_request(server_t* server, epoll_reactor* reactor, int sock)
 {
     epoll_server_private* private = (epoll_server_private*)server->private;
-    epoll_server_client* client_list = (epoll_server_client*)private->epoll_clients.items;
-    int index = sock; // To make things a bit less confusing
-    epoll_server_client* epoll_client = client_list + index;
-    epoll_server_request* request = &epoll_client->request;
+    epoll_server_request* request = fd_table_get(&private->requests, sock);
+    if (request == NULL)
+    {
+        // Closed while handling an earlier event in the same batch
+        return 0;
+    }
+    epoll_server_conn* conn = slab_cold(&reactor->slab, request);
+    framer_t* frame = &request->frame;
 
     struct timeval start;
     gettimeofday(&start, NULL);
 
     int result = 0;
-    int would_block = 0;
-    do
+    int drained = 0; // Set once a recv comes up short, i.e. the socket has nothing more for now
+
+    if (framer_acquire(frame) == -1)
     {
-        int which_message = request->transferred / (request->msg_size + sizeof(request->msg_size));
-        size_t offset = request->transferred % (request->msg_size + sizeof(request->msg_size));
+        result = -1;
+        goto cleanup;
+    }
 
-        if (offset < sizeof(request->msg_size))
+    if (request->sending)
+    {
+        // Finish echoing before reading any more from the client
+        if (frame->state == FRAME_WRITE_BODY)
+        {
+            result = flush_response(reactor, sock, request, conn);
+        }
+        else if (request->splicing)
+        {
+            result = splice_body(reactor, sock, request, conn);
+        }
+        if (result != 0)
         {
-            // We're reading a message size
-            unsigned char* raw = ((unsigned char*)&request->partial_msg_size) + offset;
-            size_t bytes_left = sizeof(request->partial_msg_size) - offset;
-            ssize_t bytes_read = read_data(sock, raw, bytes_left);
-            if (bytes_read == -1)
+            result = result == 1 ? 0 : -1;
+            goto cleanup;
+        }
+    }
+
+    while (!request->sending && !atomic_load(&done))
+    {
+        if (request->splicing)
+        {
+            result = splice_body(reactor, sock, request, conn);
+            if (result != 0)
             {
-                result = -1;
+                result = result == 1 ? 0 : -1;
                 goto cleanup;
             }
+            if (request->splicing)
+            {
+                break;
+            }
+            continue;
+        }
 
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
+        if (request->zerocopy && conn->zc_sends != conn->zc_done)
+        {
+            // The kernel may still be transmitting from msg or rbuf, so neither can be reused until it's done.
+            // Its completions raise EPOLLERR, which brings us back here.
+            if (read_zerocopy_completions(sock, &conn->zc_done) == -1)
             {
-                would_block = 1;
+                perror("recvmsg MSG_ERRQUEUE");
+                result = -1;
+                goto cleanup;
             }
-            else
+            if (conn->zc_sends != conn->zc_done)
             {
-                request->msg_size = request->partial_msg_size;
-                if (request->msg_size == 0)
-                {
-                    // Client is finished sending data
-                    goto cleanup;
-                }
-                if (request->msg == NULL)
-                {
-                    request->msg = malloc(request->msg_size);
-                    if (!request->msg)
-                    {
-                        perror("malloc");
-                        result = -1;
-                        goto cleanup;
-                    }
-                }
+                break;
             }
         }
-        else
-        {
-            // We're reading message content
-            offset -= sizeof(request->msg_size);
-            size_t bytes_left = request->msg_size - offset;
-            ssize_t bytes_read = read_data(sock, request->msg, bytes_left);
 
-            if (bytes_read == -1)
+        int status = framer_parse(frame, server_options.splice_threshold);
+        if (status == FRAMES_ECHO)
+        {
+            if (flush_response(reactor, sock, request, conn) == -1)
             {
                 result = -1;
                 goto cleanup;
             }
+            continue;
+        }
+        else if (status == FRAMES_FINISHED)
+        {
+            goto cleanup;
+        }
+        else if (status == FRAMES_ERROR)
+        {
+            result = -1;
+            goto cleanup;
+        }
+        else if (drained)
+        {
+            break;
+        }
 
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
+        // Everything buffered has been parsed, so refill the buffer with as much as the socket holds
+        ssize_t bytes_read = framer_recv(frame, sock, &drained);
+        if (bytes_read == -1)
+        {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
             {
-                // We've received a full message; echo back to the client
-                ssize_t bytes_sent;
-                size_t send_bytes_left = (ssize_t)request->msg_size;
-                do
-                {
-                    bytes_sent = send_data(sock, request->msg + (request->msg_size - send_bytes_left), send_bytes_left);
-                    send_bytes_left -= bytes_sent;
-                } while(bytes_sent != -1 && send_bytes_left > 0);
-                
-                if (bytes_sent == -1)
-                {
-                    result = -1;
-                    goto cleanup;
-                }
+                stats_would_block(STATS_OP_RECV);
+                break;
             }
+            result = -1;
+            goto cleanup;
         }
-    } while(!would_block && !atomic_load(&done));
+        else if (bytes_read == 0)
+        {
+            // Client hung up without sending a zero size
+            goto cleanup;
+        }
+        stats_bytes_received((size_t)bytes_read);
+        stats_message_ready(&conn->timer);
+    }
 
     {
         struct timeval end;
         gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
+        conn->transfer_time += TIME_DIFF(start, end);
+    }
+
+    // Between messages an idle connection only costs its slab record; the buffers go back to this thread's
+    // pool, unless the kernel may still be sending from them
+    if (!request->sending && !request->splicing && (!request->zerocopy || conn->zc_sends == conn->zc_done))
+    {
+        framer_release(frame);
     }
 
+    set_deadline(reactor, request, conn);
     return 0;
 
 cleanup:
-    --private->connected_count;
-
     if (result == 0)
     {
         // Success, so write results to file
         struct timeval end;
         gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
+        conn->transfer_time += TIME_DIFF(start, end);
 
-        unsigned short src_port = ntohs(epoll_client->client.peer.sin_port);
-        char *addr = inet_ntoa(epoll_client->client.peer.sin_addr);
-        char csv[256];
-        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request->transfer_time, request->transferred, addr, src_port);
-        log_msg(csv);
+        transfer_log_append(&end, conn->transfer_time, frame->transferred, frame->messages, &conn->peer);
+        stats_connection_closed(conn->transfer_time);
 
-        char pretty[256];
-        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
-              request->transfer_time, request->transferred, addr, src_port);
-        printf("%s", pretty);
+        if (server_options.verbose)
+        {
+            unsigned short src_port = ntohs(conn->peer.sin_port);
+            char *addr = inet_ntoa(conn->peer.sin_addr);
+            printf("Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+                   conn->transfer_time, frame->transferred, addr, src_port);
+        }
     }
     else
     {
         perror("oops!");
+        stats_connection_closed(-1);
     }
 
-    struct epoll_event ev;
-    epoll_ctl(private->epfd, EPOLL_CTL_DEL, sock, &ev);
-
-    close(sock);
-    free(request->msg);
-
-    // Reset everything for the next client
-    //FD_CLR(sock, &set->set);
-    request->msg = NULL;
-    request->msg_size = 0;
-    request->partial_msg_size = 0;
-    request->transferred = 0;
-    request->transfer_time = 0;
-    epoll_client->client.sock = -1;
+    close_client(reactor, sock, request, conn);
     return result;
 }
 
+/**
+ * Adds a new client to the given reactor. Must be called from the thread that accepts clients for that
+ * reactor. A client that can't be added is closed, so a failure only ever costs that one client.
+ *
+ * @param reactor      The reactor that will serve the client.
+ * @param client       The newly accepted client.
+ * @param from_reactor Whether this is the reactor's own thread, which can register the client and start its
+ *                     idle deadline itself; otherwise the client is queued for the reactor to do both.
+ * @return 0 on success, or -1 if the client was rejected.
+ */
+static int reactor_add_client(epoll_reactor* reactor, client_t client, int from_reactor)
+{
+    epoll_server_private* priv = (epoll_server_private*)reactor->server->private;
+
+    epoll_server_request* request = slab_alloc(&reactor->slab);
+    if (request == NULL)
+    {
+        perror("slab_alloc");
+        reject_client(client.sock);
+        return -1;
+    }
+    epoll_server_conn* conn = slab_cold(&reactor->slab, request);
+    conn->peer = client.peer;
+    conn->sock = client.sock;
+
+    if (server_options.splice_threshold != 0)
+    {
+        // A spliced echo goes out as a send of the buffered part followed by several splices, so Nagle
+        // would hold its last small piece back until the client's delayed ACK
+        int one = 1;
+        stats_setup_calls(1);
+        if (setsockopt(client.sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1)
+        {
+            perror("setsockopt TCP_NODELAY");
+        }
+    }
+
+    if (server_options.zerocopy_threshold != 0)
+    {
+        int one = 1;
+        stats_setup_calls(1);
+        if (setsockopt(client.sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1)
+        {
+            perror("setsockopt SO_ZEROCOPY");
+        }
+        else
+        {
+            request->zerocopy = 1;
+        }
+    }
+
+    // The slot has to be filled in before the reactor can see events for the socket
+    if (fd_table_set(&priv->requests, client.sock, request) == -1)
+    {
+        fprintf(stderr, "No room in the connection table for socket %d\n", client.sock);
+        slab_free(&reactor->slab, request);
+        reject_client(client.sock);
+        return -1;
+    }
+
+    if (!from_reactor)
+    {
+        // The reactor registers the socket when it takes the list, so that a failure is dealt with on the
+        // thread that owns the client
+        // Once the client is on the list the reactor may take it at any time, so only head is looked at
+        // afterwards
+        conn->deadline.expires = timer_wheel_clock(); // Only until the reactor picks the client up
+        timer_entry* head = atomic_load(&reactor->arriving);
+        do
+        {
+            conn->deadline.next = head;
+        }
+        while (!atomic_compare_exchange_weak(&reactor->arriving, &head, &conn->deadline));
+
+        // The reactor may be asleep with no deadlines at all; one wakeup covers everything queued before it
+        // gets round to taking the list
+        if (head == NULL)
+        {
+            uint64_t one = 1;
+            stats_setup_calls(1);
+            if (write(reactor->wake_fd, &one, sizeof(one)) == -1)
+            {
+                perror("write eventfd");
+            }
+        }
+        return 0;
+    }
+
+    set_deadline(reactor, request, conn);
+    if (register_client(reactor, request, conn) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Makes a reactor responsible for accepting clients on the given listening socket.
+ *
+ * @param reactor  The reactor that will accept clients.
+ * @param acceptor The listening socket, which will be put in non-blocking mode (as will the clients accepted
+ *                 on it).
+ * @return 0 on success, or -1 on failure.
+ */
+static int reactor_listen(epoll_reactor* reactor, acceptor_t* acceptor)
+{
+    struct epoll_event event;
+
+    if (acceptor_set_nonblocking(acceptor) == -1)
+    {
+        return -1;
+    }
+    acceptor->client_flags = SOCK_NONBLOCK;
+
+    event.events = EPOLLIN | EPOLLET | EPOLLHUP | EPOLLERR;
+    event.data.fd = acceptor->sock;
+
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, acceptor->sock, &event) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    reactor->acceptor = acceptor;
+    return 0;
+}
+
+/**
+ * Accepts clients on the reactor's listening socket until the backlog is empty or the accept budget
+ * runs out, so that an accept storm can't starve the reactor's existing clients.
+ *
+ * @param reactor The reactor, which must have a listening socket.
+ * @return 1 if the budget ran out first (so clients may still be waiting), 0 if the backlog was emptied,
+ *         or -1 on failure.
+ */
+static int accept_batch(epoll_reactor* reactor)
+{
+    size_t budget = server_options.accept_budget ? server_options.accept_budget : ACCEPT_PER_ITER;
+    for (size_t i = 0; i < budget; ++i)
+    {
+        client_t client;
+        if (accept_client(reactor->acceptor, &client) == -1)
+        {
+            return errno == EWOULDBLOCK || errno == EAGAIN ? 0 : -1;
+        }
+        // A client that can't be added has already been closed; the rest are still worth accepting
+        reactor_add_client(reactor, client, 1);
+    }
+
+    return 1;
+}
+
+/**
+ * Runs a reactor's event loop until done is set or an error occurs. If the reactor has a listening
+ * socket, clients accepted on it are served by this reactor.
+ *
+ * @param reactor The reactor to run.
+ * @return 0 on success, or -1 on failure.
+ */
+static int reactor_run(epoll_reactor* reactor)
+{
+    acceptor_t* acceptor = reactor->acceptor;
+    struct epoll_event events[NUM_EPOLL_EVENTS];
+    int err = 0;
+    int accept_pending = 0; // The listener is edge-triggered, so a backlog left over by the budget won't be reported again
+
+    // So that the reactors don't all time their messages into the same histogram
+    stats_thread_histograms();
+
+    while (!err && !atomic_load(&done))
+    {
+        // Sleep until the next deadline, or for good if there isn't one; shutdown and new arrivals come in
+        // as events
+        int timeout = accept_pending ? 0 : timer_wheel_timeout(&reactor->timers, reactor->now);
+        int epoll_ready = epoll_wait(reactor->epfd, events, NUM_EPOLL_EVENTS, timeout);
+        if (epoll_ready == -1)
+        {
+            if (errno != EINTR)
+            {
+                perror("epoll_wait");
+                err = 1;
+                break;
+            }
+            epoll_ready = 0;
+        }
+
+        reactor->now = timer_wheel_clock();
+        start_arrivals(reactor);
+
+        for (int index = 0; index < epoll_ready && !atomic_load(&done); index++)
+        {
+            int fd = events[index].data.fd;
+            if (acceptor && fd == acceptor->sock)
+            {
+                accept_pending = 1;
+            }
+            else if (fd == reactor->wake_fd)
+            {
+                // Reset before taking the list again, so that a client queued in between still gets a wakeup
+                uint64_t count;
+                if (read(reactor->wake_fd, &count, sizeof(count)) == sizeof(count))
+                {
+                    start_arrivals(reactor);
+                }
+            }
+            else if (fd == done_signal_fd() || fd == done_event_fd())
+            {
+                done_check();
+            }
+            else if (handle_request(reactor->server, reactor, fd) == -1)
+            {
+                err = 1;
+            }
+
+            if (err)
+            {
+                break;
+            }
+        }
+
+        // Accept after serving the clients that were already ready, so they don't wait behind a flood of new ones
+        if (!err && accept_pending)
+        {
+            accept_pending = accept_batch(reactor);
+            err = accept_pending == -1;
+        }
+
+        timer_wheel_advance(&reactor->timers, reactor->now, deadline_expired, reactor);
+    }
+
+    return err ? -1 : 0;
+}
+
+/**
+ * Entry point for reactor threads in the multi-reactor server.
+ *
+ * @param void_reactor The reactor to run.
+ * @return NULL.
+ */
+static void* reactor_thread(void* void_reactor)
+{
+    epoll_reactor* reactor = (epoll_reactor*)void_reactor;
+    epoll_server_private* priv = (epoll_server_private*)reactor->server->private;
+
+    // Pinned before the loop allocates anything, so that its buffers come from the local node
+    char role[32];
+    size_t index = (size_t)(reactor - priv->reactors);
+    snprintf(role, sizeof(role), "Reactor %zu", index);
+    placement_pin(role, index);
+
+    if (reactor_run(reactor) == -1)
+    {
+        done_set();
+    }
+    return NULL;
+}
+
+/**
+ * Prints how much memory each connection takes across all of the reactors' slabs, plus its table slot. That's
+ * all an idle connection costs: its framer's buffers go back to the pool between messages.
+ */
+static void print_connection_size(epoll_server_private* priv)
+{
+    slab_t** slabs = malloc(priv->num_reactors * sizeof(slab_t*));
+    if (slabs == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < priv->num_reactors; ++i)
+    {
+        slabs[i] = &priv->reactors[i].slab;
+    }
+    slab_print(slabs, priv->num_reactors, stdout, "Connections", sizeof(epoll_server_request*));
+    free(slabs);
+}
+
+/**
+ * Registers one of the descriptors that wake a reactor up without being a client: its wake_fd and done's
+ * signalfd and eventfd. They're level-triggered, so they stay ready until they're dealt with.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+static int reactor_watch(epoll_reactor* reactor, int fd)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Allocates the private data shared by both epoll servers, including one epoll fd per reactor.
+ *
+ * @param server       The server that will own the private data.
+ * @param num_reactors The number of event loops to create.
+ * @return The private data on success, or NULL on failure (an error message will have been printed).
+ */
+static epoll_server_private* epoll_private_create(server_t* server, size_t num_reactors)
+{
+    epoll_server_private* priv = malloc(sizeof(epoll_server_private));
+    if (priv == NULL)
+    {
+        perror("malloc priv");
+        return NULL;
+    }
+
+    priv->reactors = calloc(num_reactors, sizeof(epoll_reactor));
+    if (priv->reactors == NULL)
+    {
+        perror("malloc reactors");
+        free(priv);
+        return NULL;
+    }
+
+    if (fd_table_init(&priv->requests, fd_table_open_limit()) == -1)
+    {
+        perror("malloc requests");
+        free(priv->reactors);
+        free(priv);
+        return NULL;
+    }
+
+    priv->num_reactors = 0;
+    atomic_init(&priv->open_count, 0);
+    priv->next_reactor = 0;
+    server->private = priv;
+
+    for (size_t i = 0; i < num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &priv->reactors[i];
+        reactor->server = server;
+        if ((reactor->epfd = epoll_create(NUM_EPOLL_EVENTS)) == -1)
+        {
+            perror("epoll_create");
+            epoll_server_cleanup(server);
+            return NULL;
+        }
+        if ((reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+        {
+            perror("eventfd");
+            close(reactor->epfd);
+            epoll_server_cleanup(server);
+            return NULL;
+        }
+        if (reactor_watch(reactor, reactor->wake_fd) == -1 || reactor_watch(reactor, done_signal_fd()) == -1 ||
+            reactor_watch(reactor, done_event_fd()) == -1)
+        {
+            close(reactor->wake_fd);
+            close(reactor->epfd);
+            epoll_server_cleanup(server);
+            return NULL;
+        }
+        if (slab_init(&reactor->slab, REQUEST_SLOT_SIZE, sizeof(epoll_server_conn)) == -1)
+        {
+            fprintf(stderr, "slab_init failed\n");
+            close(reactor->wake_fd);
+            close(reactor->epfd);
+            epoll_server_cleanup(server);
+            return NULL;
+        }
+        reactor->now = timer_wheel_clock();
+        timer_wheel_init(&reactor->timers, reactor->now);
+        atomic_init(&reactor->arriving, NULL);
+        ++priv->num_reactors;
+    }
+
+    print_connection_size(priv);
+    return priv;
+}
+
 /*********************************************************************************************
 FUNCTION
 
@@ -264,150 +1083,182 @@ static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handl
 {
     *handles_accept = 1;
 
-    int epoll_ready = 0;
-    struct epoll_event event;
-    struct epoll_event events[NUM_EPOLL_EVENTS];
-    
-    epoll_server_private* priv = malloc(sizeof(epoll_server_private));
-    if (priv == NULL)
+    epoll_server_private* priv = epoll_private_create(server, 1);
+    if (priv == NULL || reactor_listen(&priv->reactors[0], acceptor) == -1)
     {
-        perror("malloc priv");
-        return -1;        
+        return -1;
     }
 
-    priv->connected_count = 0;
+    return reactor_run(&priv->reactors[0]);
+}
 
-    int result = vector_init(&priv->epoll_clients, sizeof(epoll_server_client), NUM_EPOLL_EVENTS);
-    if (result == -1)
-    {
-        perror("malloc clients");
-        free(priv);
-        return -1;
-    }
+/*********************************************************************************************
+FUNCTION
 
-    // Set accept socket to non-blocking mode
-    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
-    {
-        perror("fnctl");
-        return -1;
-    }
+    Name:		epoll_mt_server_start
 
-    server->private = priv;
+    Prototype:	static int epoll_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 0 unless --reuseport is given, in which case the reactors accept
+                     clients themselves.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Starts the multi-reactor epoll server: one event loop per thread (one per online CPU unless
+    overridden with --reactors), each with its own epoll fd. New clients are spread across the
+    reactors round-robin by epoll_server_add_client, or, with --reuseport, each reactor binds its
+    own SO_REUSEPORT listener and accepts locally so that there is no single accept hot spot.
+
+    Revisions:
+	(none)
 
-    if ((priv->epfd = epoll_create(NUM_EPOLL_EVENTS)) == -1)
+*********************************************************************************************/
+static int epoll_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = server_options.reuse_port;
+    acceptor->client_flags = SOCK_NONBLOCK;
+
+    long num_reactors = server_options.num_reactors;
+    if (num_reactors == 0)
     {
-        perror("epoll_create");
-        return -1;
+        num_reactors = sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_reactors < 1)
+        {
+            num_reactors = 1;
+        }
     }
-    event.events = EPOLLIN | EPOLLET | EPOLLHUP | EPOLLERR;
-    event.data.fd = acceptor->sock;
 
-    if (epoll_ctl(priv->epfd, EPOLL_CTL_ADD, acceptor->sock, &event) == -1)
+    epoll_server_private* priv = epoll_private_create(server, (size_t)num_reactors);
+    if (priv == NULL)
     {
-        perror("epoll_ctl");
         return -1;
     }
 
-    while (1)
+    // In sharded mode, every reactor accepts on its own listener and the kernel balances connections between
+    // them; reactor 0 reuses the listener serve() created and runs on this thread.
+    size_t first_threaded = 0;
+    if (server_options.reuse_port)
     {
-        epoll_ready = epoll_wait(priv->epfd, events, NUM_EPOLL_EVENTS, 3000);
-        if (epoll_ready == -1)
-        {
-            perror("epoll_wait");
-            break;
-        }else if (epoll_ready == 0)
+        if (reactor_listen(&priv->reactors[0], acceptor) == -1)
         {
-            printf("timed out\n");
-            continue;
+            return -1;
         }
-        // printf("number of events ready: %d\n", epoll_ready);
-        int index;
-        int err = 0;
-        for (index = 0; index < epoll_ready && !atomic_load(&done); index++)
+
+        for (size_t i = 1; i < priv->num_reactors; ++i)
         {
-            if (events[index].data.fd == acceptor->sock)
+            epoll_reactor* reactor = &priv->reactors[i];
+            if (acceptor_open(&reactor->own_acceptor, acceptor->port, 1) == -1)
             {
-                while(1)//for (size_t i = 0; i < ACCEPT_PER_ITER; ++i)
-                {
-                    client_t client;
-                    int accept_result = accept_client(acceptor, &client);
-                    if (accept_result == -1)
-                    {
-                        if (errno != EWOULDBLOCK && errno != EAGAIN)
-                        {
-                            err = 1;
-                        }
-                        break;
-                    }
-                    // if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
-                    // {
-                    //     perror("fnctl");
-                    //     return -1;
-                    // }
-                    if (server->add_client(server, client) == -1)
-                    {
-                        err = 1;
-                        break;
-                    }
-                    else
-                    {
-                        // printf("Added client\n");
-                    }
-                }
+                return -1;
             }
-            else
+
+            if (reactor_listen(reactor, &reactor->own_acceptor) == -1)
             {
-                int request_result = handle_request(server, events[index].data.fd);
-                if (request_result == -1)
-                {
-                    err = 1;
-                    break;
-                }
+                cleanup_acceptor(&reactor->own_acceptor);
+                return -1;
             }
         }
-        if (err)
+        first_threaded = 1;
+    }
+
+    int result = 0;
+    for (size_t i = first_threaded; i < priv->num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &priv->reactors[i];
+        if (pthread_create(&reactor->thread, NULL, reactor_thread, reactor) != 0)
         {
+            fprintf(stderr, "pthread_create failed for reactor %zu\n", i);
+            done_set();
+            result = -1;
             break;
         }
+        reactor->threaded = 1;
     }
 
-    return (errno && errno != EINTR) * -1;
+    if (result == 0)
+    {
+        printf("Started %zu reactors%s\n", priv->num_reactors, server_options.reuse_port ? " with SO_REUSEPORT listeners" : "");
+        if (server_options.reuse_port)
+        {
+            result = reactor_run(&priv->reactors[0]);
+        }
+    }
+
+    return result;
 }
 
 static int epoll_server_add_client(server_t* server, client_t client)
 {
-    struct epoll_event event;
     epoll_server_private* priv = (epoll_server_private*)server->private;
-
-    if (fcntl(client.sock, F_SETFL, O_NONBLOCK | fcntl(client.sock, F_GETFL, 0)) == -1)
-    {
-        perror("fnctl");
-        return -1;
-    }
-
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = client.sock;
-    if (epoll_ctl(priv->epfd, EPOLL_CTL_ADD, client.sock, &event) == -1)
+    epoll_reactor* reactor = &priv->reactors[priv->next_reactor];
+    if (++priv->next_reactor == priv->num_reactors)
     {
-        perror("epoll_ctl");
-        return -1;
+        priv->next_reactor = 0;
     }
-    ++server->total_served;
-    ++priv->connected_count;
-    if (priv->connected_count > server->max_concurrent)
-    {
-        server->max_concurrent = priv->connected_count;
-    }    
 
-    epoll_server_client* clients = (epoll_server_client*)priv->epoll_clients.items;
-    clients[client.sock].client = client;
-    return 0;
+    return reactor_add_client(reactor, client, 0);
 }
 
 static void epoll_server_cleanup(server_t* epoll_server)
 {
     epoll_server_private* private = (epoll_server_private*)epoll_server->private;
-    vector_free(&private->epoll_clients);
+    if (private == NULL)
+    {
+        return;
+    }
+
+    done_set();
+    for (size_t i = 0; i < private->num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &private->reactors[i];
+        if (reactor->threaded)
+        {
+            pthread_join(reactor->thread, NULL);
+        }
+        if (reactor->acceptor == &reactor->own_acceptor)
+        {
+            // serve() reports the accept stats of the listener it created, which reactor 0 accepts on
+            acceptor_merge_stats(private->reactors[0].acceptor, reactor->acceptor);
+            cleanup_acceptor(reactor->acceptor);
+        }
+
+        close(reactor->wake_fd);
+        close(reactor->epfd);
+    }
+
+    // Connections still open at shutdown
+    for (size_t sock = 0; sock < private->requests.max_fds; ++sock)
+    {
+        epoll_server_request* request = fd_table_get(&private->requests, (int)sock);
+        if (request != NULL)
+        {
+            framer_free(&request->frame);
+            if (request->has_pipe)
+            {
+                // Every reactor's slab has the same layout, so any of them can find the cold part
+                epoll_server_conn* conn = slab_cold(&private->reactors[0].slab, request);
+                close(conn->pipefd[0]);
+                close(conn->pipefd[1]);
+            }
+        }
+    }
+
+    print_connection_size(private);
+    for (size_t i = 0; i < private->num_reactors; ++i)
+    {
+        slab_destroy(&private->reactors[i].slab);
+    }
+    fd_table_destroy(&private->requests);
+    free(private->reactors);
     free(private);
-    close(private->epfd);
-}
\ No newline at end of file
+    epoll_server->private = NULL;
+}
@@ -16,14 +16,18 @@ Revisions:
 
 #include <stdio.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 
-#include "log.h"
+#include "transfer_log.h"
 #include "server.h"
+#include "options.h"
+#include "placement.h"
+#include "stats.h"
 
 #define DEFAULT_PORT 8005
 
@@ -52,13 +56,47 @@ Revisions:
 *********************************************************************************************/
 void print_usage(char const* name)
 {
-    printf("usage: %s [-h] [-p port]\n", name);
+    printf("usage: %s [-h] [-p port] [-s server] [-r reactors] [-R] [-z n] [-Z n] [-a n] [-i secs] [-m addr] [-c cpus] [-t secs] [-w workers] [-v]\n", name);
     printf("\t-h, --help:          print this help message and exit.\n");
     printf("\t-p, --port [port]:   the port on which to listen for connections;\n");
     printf("\t                     default is %u.\n", DEFAULT_PORT);
     printf("\t-s, --server [name]: the server used to handle connections.\n");
-    printf("\t                     Valid values are thread, select, or epoll.");
-    printf("\t                     Default is epoll.");
+    printf("\t                     Valid values are thread, select, epoll, epoll-mt or uring.\n");
+    printf("\t                     Default is epoll.\n");
+    printf("\t-r, --reactors [n]:  the number of event loops used by epoll-mt;\n");
+    printf("\t                     default is one per online CPU.\n");
+    printf("\t-R, --reuseport:     set SO_REUSEPORT on the listening socket. epoll-mt gives each\n");
+    printf("\t                     reactor its own listener; other servers can be run as several\n");
+    printf("\t                     processes sharing the port.\n");
+    printf("\t-z, --splice [n]:    have epoll and epoll-mt echo messages of at least n bytes with\n");
+    printf("\t                     splice() instead of copying them; default is off.\n");
+    printf("\t-Z, --zerocopy [n]:  have epoll and epoll-mt send echoes of at least n bytes with\n");
+    printf("\t                     MSG_ZEROCOPY; default is off.\n");
+    printf("\t-a, --accept-budget [n]:\n");
+    printf("\t                     the most clients epoll, epoll-mt and select accept per\n");
+    printf("\t                     wakeup before serving existing clients again.\n");
+    printf("\t-i, --interval [secs]:\n");
+    printf("\t                     print connections and bytes per second, active connections\n");
+    printf("\t                     and transfer time percentiles every secs seconds;\n");
+    printf("\t                     default is %u, 0 turns the report off.\n", STATS_DEFAULT_INTERVAL);
+    printf("\t-m, --metrics [addr]:\n");
+    printf("\t                     serve Prometheus metrics on addr, which is either a port\n");
+    printf("\t                     (bound on 127.0.0.1) or the path of a Unix domain socket.\n");
+    printf("\t-c, --cpus [list]:   pin the server's threads to these CPUs, e.g. 0-3,8,10-11,\n");
+    printf("\t                     in order and wrapping around, and allocate their memory\n");
+    printf("\t                     on the CPU's NUMA node; default is no pinning.\n");
+    printf("\t-t, --timeouts [idle[,header[,write]]]:\n");
+    printf("\t                     seconds after which epoll, epoll-mt and select close a client\n");
+    printf("\t                     that has sent nothing, is part way through a message's size,\n");
+    printf("\t                     or isn't reading its echo; defaults are %u,%u,%u, 0 disables one.\n",
+           DEFAULT_IDLE_TIMEOUT, DEFAULT_HEADER_TIMEOUT, DEFAULT_WRITE_TIMEOUT);
+    printf("\t-w, --workers [min[,max[,idle]]]:\n");
+    printf("\t                     the threads the thread server keeps, the most it starts,\n");
+    printf("\t                     and seconds a thread above min may be idle before it exits;\n");
+    printf("\t                     defaults are %u,%u,%u, an idle of 0 keeps every thread.\n",
+           DEFAULT_MIN_WORKERS, DEFAULT_MAX_WORKERS, DEFAULT_WORKER_IDLE);
+    printf("\t-v, --verbose:       also print the transfer time of every connection; SIGHUP\n");
+    printf("\t                     turns this on or off while the server runs.\n");
 }
 
 /*********************************************************************************************
@@ -90,15 +128,34 @@ int main(int argc, char** argv)
     unsigned short port = DEFAULT_PORT;
     server_t* server = epoll_server;
 
-    char const* short_opts = "p:s:h";
+    char const* short_opts = "p:s:r:Rz:Z:a:i:m:c:t:w:vh";
     struct option long_opts[] =
     {
-        {"port",   1, NULL, 'p'},
-        {"server", 1, NULL, 's'},
-        {"help",   0, NULL, 'h'},
+        {"port",      1, NULL, 'p'},
+        {"server",    1, NULL, 's'},
+        {"reactors",  1, NULL, 'r'},
+        {"reuseport", 0, NULL, 'R'},
+        {"splice",    1, NULL, 'z'},
+        {"zerocopy",  1, NULL, 'Z'},
+        {"accept-budget", 1, NULL, 'a'},
+        {"interval",  1, NULL, 'i'},
+        {"metrics",   1, NULL, 'm'},
+        {"cpus",      1, NULL, 'c'},
+        {"timeouts",  1, NULL, 't'},
+        {"workers",   1, NULL, 'w'},
+        {"verbose",   0, NULL, 'v'},
+        {"help",      0, NULL, 'h'},
         {0, 0, 0, 0},
     };
 
+    server_options.report_interval = STATS_DEFAULT_INTERVAL;
+    server_options.idle_timeout = DEFAULT_IDLE_TIMEOUT;
+    server_options.header_timeout = DEFAULT_HEADER_TIMEOUT;
+    server_options.write_timeout = DEFAULT_WRITE_TIMEOUT;
+    server_options.min_workers = DEFAULT_MIN_WORKERS;
+    server_options.max_workers = DEFAULT_MAX_WORKERS;
+    server_options.worker_idle = DEFAULT_WORKER_IDLE;
+
     struct rlimit open_file_limit;
     open_file_limit.rlim_cur = 131072;
     open_file_limit.rlim_max = 131072;
@@ -139,6 +196,16 @@ int main(int argc, char** argv)
                         server = epoll_server;
                         printf("epoll");
                     }
+                    else if (strcmp(optarg, "epoll-mt") == 0)
+                    {
+                        server = epoll_mt_server;
+                        printf("epoll-mt");
+                    }
+                    else if (strcmp(optarg, "uring") == 0)
+                    {
+                        server = uring_server;
+                        printf("uring");
+                    }
                     else if (strcmp(optarg, "select") == 0)
                     {
                         server = select_server;
@@ -156,6 +223,148 @@ int main(int argc, char** argv)
                     }
                 }
                 break;
+                case 'r':
+                {
+                    unsigned int reactors;
+                    int num_read = sscanf(optarg, "%u", &reactors);
+                    if (num_read != 1 || reactors == 0)
+                    {
+                        fprintf(stderr, "Invalid number of reactors %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.num_reactors = reactors;
+                    }
+                }
+                break;
+                case 'R':
+                    server_options.reuse_port = 1;
+                break;
+                case 'z':
+                {
+                    unsigned int threshold;
+                    int num_read = sscanf(optarg, "%u", &threshold);
+                    if (num_read != 1 || threshold == 0)
+                    {
+                        fprintf(stderr, "Invalid splice threshold %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.splice_threshold = threshold;
+                    }
+                }
+                break;
+                case 'Z':
+                {
+                    unsigned int threshold;
+                    int num_read = sscanf(optarg, "%u", &threshold);
+                    if (num_read != 1 || threshold == 0)
+                    {
+                        fprintf(stderr, "Invalid zerocopy threshold %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.zerocopy_threshold = threshold;
+                    }
+                }
+                break;
+                case 'a':
+                {
+                    unsigned int budget;
+                    int num_read = sscanf(optarg, "%u", &budget);
+                    if (num_read != 1 || budget == 0)
+                    {
+                        fprintf(stderr, "Invalid accept budget %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.accept_budget = budget;
+                    }
+                }
+                break;
+                case 'i':
+                {
+                    unsigned int interval;
+                    int num_read = sscanf(optarg, "%u", &interval);
+                    if (num_read != 1)
+                    {
+                        fprintf(stderr, "Invalid report interval %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.report_interval = interval;
+                    }
+                }
+                break;
+                case 'm':
+                    server_options.metrics_address = optarg;
+                break;
+                case 't':
+                {
+                    unsigned int timeouts[3] = { server_options.idle_timeout, server_options.header_timeout,
+                                                 server_options.write_timeout };
+                    int end = 0;
+                    int num_read = sscanf(optarg, "%u%n,%u%n,%u%n", &timeouts[0], &end, &timeouts[1], &end,
+                                          &timeouts[2], &end);
+                    if (num_read < 1 || optarg[end] != '\0')
+                    {
+                        fprintf(stderr, "Invalid timeouts %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.idle_timeout = timeouts[0];
+                        server_options.header_timeout = timeouts[1];
+                        server_options.write_timeout = timeouts[2];
+                    }
+                }
+                break;
+                case 'w':
+                {
+                    unsigned int workers[3] = { server_options.min_workers, server_options.max_workers,
+                                                server_options.worker_idle };
+                    int end = 0;
+                    int num_read = sscanf(optarg, "%u%n,%u%n,%u%n", &workers[0], &end, &workers[1], &end,
+                                          &workers[2], &end);
+                    if (num_read == 1 && workers[1] < workers[0])
+                    {
+                        workers[1] = workers[0];
+                    }
+                    if (num_read < 1 || optarg[end] != '\0' || workers[1] == 0 || workers[0] > workers[1])
+                    {
+                        fprintf(stderr, "Invalid workers %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        server_options.min_workers = workers[0];
+                        server_options.max_workers = workers[1];
+                        server_options.worker_idle = workers[2];
+                    }
+                }
+                break;
+                case 'c':
+                    if (placement_parse(optarg) == -1)
+                    {
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                break;
+                case 'v':
+                    server_options.verbose = 1;
+                break;
                 case 'h':
                     print_usage(argv[0]);
                     exit(EXIT_SUCCESS);
@@ -174,7 +383,7 @@ int main(int argc, char** argv)
         }
     }
 
-    if (log_open("transfers.txt") == -1)
+    if (transfer_log_open("transfers.bin") == -1)
     {
         exit(EXIT_FAILURE);
     }
@@ -185,12 +394,28 @@ int main(int argc, char** argv)
         ret = EXIT_FAILURE;
     }
 
-    int result = log_close();
+    stats_print_totals("service_times.hist");
+
+    int result = transfer_log_close();
     if (result < 0)
     {
         perror("close");
     }
-    fprintf(stderr, "Total served: %lu; Max concurrent connections: %lu\n", server->total_served, server->max_concurrent);
+    stats_counters totals;
+    stats_read(&totals, NULL, NULL);
+    fprintf(stderr, "Total served: %lu; Max concurrent connections: %lu\n", (unsigned long)totals.opened,
+            (unsigned long)totals.max_concurrent);
+    if (totals.rejected > 0)
+    {
+        fprintf(stderr, "Rejected: %lu\n", (unsigned long)totals.rejected);
+    }
+    if (totals.timed_out[STATS_TIMEOUT_IDLE] + totals.timed_out[STATS_TIMEOUT_HEADER] +
+        totals.timed_out[STATS_TIMEOUT_WRITE] > 0)
+    {
+        fprintf(stderr, "Timed out: %" PRIu64 " idle, %" PRIu64 " header, %" PRIu64 " write\n",
+                totals.timed_out[STATS_TIMEOUT_IDLE], totals.timed_out[STATS_TIMEOUT_HEADER],
+                totals.timed_out[STATS_TIMEOUT_WRITE]);
+    }
     fflush(stderr);
 
     return ret;
@@ -0,0 +1,438 @@
+/*********************************************************************************************
+Name:			metrics.c
+
+    Required:	metrics.h
+                stats.h
+                histogram.h
+                transfer_log.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Prometheus text endpoint for the live server stats. A single side thread owns the
+    listening socket and answers one connection at a time; it only ever reads the counters
+    the servers already keep, so nothing on the request path takes a lock or waits for it.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE // accept4, pipe2
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "histogram.h"
+#include "metrics.h"
+#include "stats.h"
+#include "transfer_log.h"
+
+#define METRICS_BACKLOG      16
+#define METRICS_REQUEST_WAIT 100 // Milliseconds to wait for a request before answering anyway
+#define METRICS_IO_TIMEOUT   1   // Seconds a slow client may hold up the thread for
+#define METRICS_BUCKETS      27  // Histogram buckets at 1us, 2us, 4us, ... up to 2^26us (about 67s)
+
+static int listen_fd = -1;
+static int wake_pipe[2] = {-1, -1};
+static char* socket_path; // Set for a Unix domain socket, so it can be removed afterwards
+static pthread_t metrics_thread;
+static int metrics_running;
+
+/**
+ * Creates the listening socket for the given address.
+ *
+ * @param address A port number or a socket path.
+ * @return The socket, or -1 on failure.
+ */
+static int open_listener(char const* address)
+{
+    char* end;
+    unsigned long port = strtoul(address, &end, 10);
+    int is_port = *address != '\0' && *end == '\0';
+
+    int sock = socket(is_port ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    if (is_port)
+    {
+        if (port > UINT16_MAX)
+        {
+            fprintf(stderr, "Invalid metrics port %s.\n", address);
+            close(sock);
+            return -1;
+        }
+
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+        {
+            perror("bind metrics port");
+            close(sock);
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Metrics socket path %s is too long.\n", address);
+            close(sock);
+            return -1;
+        }
+        strcpy(addr.sun_path, address);
+
+        // A server that was killed leaves its socket file behind
+        unlink(address);
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+        {
+            perror("bind metrics socket");
+            close(sock);
+            return -1;
+        }
+        socket_path = strdup(address);
+    }
+
+    if (listen(sock, METRICS_BACKLOG) == -1)
+    {
+        perror("listen");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+static void write_metric(FILE* out, char const* name, char const* type, char const* help, uint64_t value)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %" PRIu64 "\n", name, help, name, type, name, value);
+}
+
+/**
+ * Writes a histogram of microseconds as a Prometheus histogram in seconds. The buckets are at powers of two
+ * so that they line up with the histogram's own.
+ */
+static void write_histogram(FILE* out, char const* name, char const* help, histogram_t const* histogram)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (int i = 0; i < METRICS_BUCKETS; ++i)
+    {
+        // Everything up to the bound; past 2 * HISTOGRAM_SUB_BUCKETS, values of exactly the bound land in
+        // the next bucket
+        uint64_t bound = (uint64_t)1 << i;
+        fprintf(out, "%s_bucket{le=\"%g\"} %" PRIu64 "\n", name, bound / 1e6,
+                histogram_count_below(histogram, bound + 1));
+    }
+
+    uint64_t count = histogram_count(histogram);
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, count);
+    fprintf(out, "%s_sum %.6f\n", name, histogram_sum(histogram) / 1e6);
+    fprintf(out, "%s_count %" PRIu64 "\n", name, count);
+}
+
+/**
+ * Formats all of the metrics.
+ *
+ * @param len Set to the length of the text.
+ * @return The text, which the caller frees, or NULL if out of memory.
+ */
+static char* format_metrics(size_t* len)
+{
+    // Each about 30 KB, and only this thread uses them
+    static histogram_t service_times;
+    static histogram_t transfer_times;
+
+    stats_counters counters;
+    stats_read(&counters, &service_times, &transfer_times);
+
+    size_t log_written, log_dropped;
+    transfer_log_counts(&log_written, &log_dropped);
+
+    char* text = NULL;
+    FILE* out = open_memstream(&text, len);
+    if (out == NULL)
+    {
+        perror("open_memstream");
+        return NULL;
+    }
+
+    write_metric(out, "echo_connections_active", "gauge", "Connections currently open.",
+                 counters.opened > counters.closed ? counters.opened - counters.closed : 0);
+    write_metric(out, "echo_connections_accepted_total", "counter", "Connections accepted.", counters.opened);
+    write_metric(out, "echo_connections_closed_total", "counter", "Connections closed.", counters.closed);
+    write_metric(out, "echo_connections_rejected_total", "counter", "Connections closed without being served.",
+                 counters.rejected);
+    write_metric(out, "echo_received_bytes_total", "counter", "Bytes received from clients.",
+                 counters.bytes_received);
+    write_metric(out, "echo_sent_bytes_total", "counter", "Bytes echoed back to clients.", counters.bytes_sent);
+    write_metric(out, "echo_messages_total", "counter", "Messages echoed.", counters.messages);
+
+    static char const* op_names[STATS_NUM_OPS] = { "recv", "send", "accept" };
+    fprintf(out, "# HELP echo_would_block_total Operations that returned EWOULDBLOCK, or sends that only took part "
+                 "of the data.\n# TYPE echo_would_block_total counter\n");
+    for (int op = 0; op < STATS_NUM_OPS; ++op)
+    {
+        fprintf(out, "echo_would_block_total{op=\"%s\"} %" PRIu64 "\n", op_names[op], counters.would_block[op]);
+    }
+
+    static char const* timeout_names[STATS_NUM_TIMEOUTS] = { "idle", "header", "write" };
+    fprintf(out, "# HELP echo_timeouts_total Connections closed for missing a deadline.\n"
+                 "# TYPE echo_timeouts_total counter\n");
+    for (int kind = 0; kind < STATS_NUM_TIMEOUTS; ++kind)
+    {
+        fprintf(out, "echo_timeouts_total{kind=\"%s\"} %" PRIu64 "\n", timeout_names[kind],
+                counters.timed_out[kind]);
+    }
+
+    write_metric(out, "echo_transfer_log_records_total", "counter", "Records written to the transfer log.",
+                 log_written);
+    write_metric(out, "echo_transfer_log_dropped_total", "counter", "Records the transfer log had to drop.",
+                 log_dropped);
+
+    write_histogram(out, "echo_service_time_seconds",
+                    "Time from the read that completed a message to the end of its echo.", &service_times);
+    write_histogram(out, "echo_transfer_time_seconds", "Time spent serving each finished connection.",
+                    &transfer_times);
+
+    if (fclose(out) == EOF)
+    {
+        perror("open_memstream");
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/**
+ * Sends all of a buffer, giving up if the client stops reading.
+ */
+static int send_all(int sock, char const* buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t sent = send(sock, buf, len, MSG_NOSIGNAL);
+        if (sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buf += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * Answers one metrics connection.
+ */
+static void serve_metrics(int sock)
+{
+    struct timeval timeout = { METRICS_IO_TIMEOUT, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // HTTP clients send their request straight away; nc and friends may send nothing at all
+    char request[1024];
+    ssize_t request_len = 0;
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    if (poll(&pfd, 1, METRICS_REQUEST_WAIT) == 1)
+    {
+        request_len = recv(sock, request, sizeof(request), MSG_DONTWAIT);
+    }
+
+    size_t len;
+    char* text = format_metrics(&len);
+    if (text == NULL)
+    {
+        return;
+    }
+
+    if (request_len >= 4 && memcmp(request, "GET ", 4) == 0)
+    {
+        char header[128];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n\r\n", len);
+        if (send_all(sock, header, (size_t)header_len) == -1)
+        {
+            free(text);
+            return;
+        }
+    }
+    send_all(sock, text, len);
+    free(text);
+}
+
+static void* metrics_func(void* arg)
+{
+    (void)arg;
+    while (1)
+    {
+        struct pollfd fds[2] = { { listen_fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (fds[1].revents)
+        {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int sock = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (sock != -1)
+            {
+                serve_metrics(sock);
+                close(sock);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		metrics_start
+
+    Prototype:	int metrics_start(char const* address)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    address - a TCP port or the path of a Unix domain socket.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Opens the listener and starts the metrics thread.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int metrics_start(char const* address)
+{
+    listen_fd = open_listener(address);
+    if (listen_fd == -1)
+    {
+        return -1;
+    }
+
+    if (pipe2(wake_pipe, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        metrics_stop();
+        return -1;
+    }
+
+    int err = pthread_create(&metrics_thread, NULL, metrics_func, NULL);
+    if (err != 0)
+    {
+        errno = err;
+        perror("pthread_create");
+        metrics_stop();
+        return -1;
+    }
+
+    metrics_running = 1;
+    printf("Serving metrics on %s\n", address);
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		metrics_stop
+
+    Prototype:	void metrics_stop(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    Wakes the metrics thread through its pipe, joins it and closes everything
+    metrics_start opened. Safe to call whether or not metrics_start succeeded.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void metrics_stop(void)
+{
+    if (metrics_running)
+    {
+        char wake = 0;
+        if (write(wake_pipe[1], &wake, 1) == -1)
+        {
+            perror("write");
+        }
+        pthread_join(metrics_thread, NULL);
+        metrics_running = 0;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (wake_pipe[i] != -1)
+        {
+            close(wake_pipe[i]);
+            wake_pipe[i] = -1;
+        }
+    }
+
+    if (listen_fd != -1)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (socket_path != NULL)
+    {
+        unlink(socket_path);
+        free(socket_path);
+        socket_path = NULL;
+    }
+}
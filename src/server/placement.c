@@ -0,0 +1,262 @@
+/*********************************************************************************************
+Name:			placement.c
+
+    Required:	placement.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    CPU affinity and NUMA placement for the servers' threads. Node numbers come from sysfs
+    and the memory policy is set with the raw system call, so there's no dependency on
+    libnuma.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE // CPU_SET and friends, pthread_setaffinity_np
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "placement.h"
+
+static int cpus[CPU_SETSIZE]; // In the order given
+static int nodes[CPU_SETSIZE]; // The node of each entry in cpus, or -1 if unknown
+static size_t num_cpus;
+
+/**
+ * Finds the NUMA node of a CPU from the nodeN link in its sysfs directory.
+ *
+ * @return The node, or -1 on a kernel without NUMA support.
+ */
+static int node_of(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    int node = -1;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4]))
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/**
+ * Parses one CPU number from the list.
+ *
+ * @return The CPU, or -1 if there isn't a valid one at *pos.
+ */
+static int parse_cpu(char const** pos)
+{
+    if (!isdigit((unsigned char)**pos))
+    {
+        return -1;
+    }
+
+    char* end;
+    long cpu = strtol(*pos, &end, 10);
+    if (cpu >= CPU_SETSIZE)
+    {
+        return -1;
+    }
+    *pos = end;
+    return (int)cpu;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		placement_parse
+
+    Prototype:	int placement_parse(char const* list)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    list - comma-separated CPUs and inclusive ranges of CPUs.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Checks every CPU against the process's affinity mask, so that a typo or a CPU taken
+    away by taskset or a cgroup is reported at startup rather than as a failure to pin.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int placement_parse(char const* list)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        perror("sched_getaffinity");
+        return -1;
+    }
+
+    num_cpus = 0;
+    char const* pos = list;
+    while (1)
+    {
+        int first = parse_cpu(&pos);
+        int last = first;
+        if (first != -1 && *pos == '-')
+        {
+            ++pos;
+            last = parse_cpu(&pos);
+        }
+        if (first == -1 || last < first || (*pos != ',' && *pos != '\0'))
+        {
+            fprintf(stderr, "Invalid CPU list %s; expected something like 0-3,8,10-11.\n", list);
+            return -1;
+        }
+
+        for (int cpu = first; cpu <= last; ++cpu)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+            {
+                fprintf(stderr, "CPU %d is offline or not available to this process.\n", cpu);
+                return -1;
+            }
+            if (num_cpus == CPU_SETSIZE)
+            {
+                fprintf(stderr, "Too many CPUs in %s.\n", list);
+                return -1;
+            }
+            cpus[num_cpus] = cpu;
+            nodes[num_cpus] = node_of(cpu);
+            ++num_cpus;
+        }
+
+        if (*pos == '\0')
+        {
+            break;
+        }
+        ++pos;
+    }
+
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		placement_enabled
+
+    Prototype:	int placement_enabled(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    Non-zero if a CPU list was given.
+
+    Description:
+    Lets the servers skip printing placement details when nothing is pinned.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int placement_enabled(void)
+{
+    return num_cpus > 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		placement_pin
+
+    Prototype:	int placement_pin(char const* role, size_t slot)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    role - what the thread is, or NULL to not print anything.
+    slot - the thread's index among the threads being placed.
+
+    Return Values:
+    The CPU the thread was pinned to, or -1.
+
+    Description:
+    Sets the thread's affinity, then its memory policy to MPOL_LOCAL. Local allocation is
+    the kernel's default, but running under numactl --interleave (or anything else that
+    sets a process-wide policy) would otherwise spread the thread's memory across nodes.
+    Failing to set the policy isn't fatal; the thread is still pinned.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int placement_pin(char const* role, size_t slot)
+{
+    if (num_cpus == 0)
+    {
+        return -1;
+    }
+
+    size_t index = slot % num_cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[index], &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        errno = err;
+        perror("pthread_setaffinity_np");
+        return -1;
+    }
+
+    if (syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) == -1 && errno != ENOSYS)
+    {
+        perror("set_mempolicy");
+    }
+
+    if (role != NULL)
+    {
+        if (nodes[index] >= 0)
+        {
+            printf("%s on CPU %d (node %d)\n", role, cpus[index], nodes[index]);
+        }
+        else
+        {
+            printf("%s on CPU %d\n", role, cpus[index]);
+        }
+        fflush(stdout);
+    }
+    return cpus[index];
+}
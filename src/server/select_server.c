@@ -7,7 +7,6 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
-#include <fcntl.h>
 #include <sys/types.h>
 // #undef __FD_SETSIZE
 // #define __FD_SETSIZE 65536
@@ -17,12 +16,17 @@
 #include <arpa/inet.h>
 #include <client.h>
 
-#include "log.h"
+#include "transfer_log.h"
 #include "timing.h"
 #include "done.h"
 #include "acceptor.h"
+#include "framing.h"
 #include "protocol.h"
 #include "server.h"
+#include "options.h"
+#include "slab.h"
+#include "stats.h"
+#include "timer_wheel.h"
 
 #define EXT_FD_SETSIZE 65536
 typedef struct
@@ -37,24 +41,183 @@ static int select_server_start(server_t* server, acceptor_t* acceptor, int* hand
 static int select_server_add_client(server_t* server, client_t client);
 static void select_server_cleanup(server_t* server);
 
+#define REQUEST_SLOT_SIZE 64 // A cache line
+
+/**
+ * The part of a connection that the loop touches on every event.
+ */
 typedef struct
 {
-    ssize_t transferred;
-    time_t transfer_time;
-    uint32_t partial_msg_size; // :(
-    uint32_t msg_size;
-    char* msg;
+    framer_t frame;      // Sockets in FRAME_WRITE_BODY are watched for writability instead of readability
+    uint8_t wrote;       // Set when anything is sent, so a stalled echo's deadline isn't pushed back
 } select_server_request;
 
+_Static_assert(sizeof(select_server_request) <= REQUEST_SLOT_SIZE, "select_server_request must fit in a cache line");
+
+/**
+ * The rest of a connection, kept in the same slab record as its request and only touched for stats and
+ * deadlines.
+ */
+typedef struct
+{
+    struct sockaddr_in peer;
+    time_t transfer_time;
+    stats_timer timer;
+    timer_entry deadline;  // In the timer wheel while one of the connection's deadlines is on
+    int sock;
+    uint32_t deadline_messages; // The message count when the deadline was set
+    uint8_t deadline_kind; // A stats_timeout
+} select_server_conn;
+
 typedef struct
 {
     ext_fd_set set;
+    ext_fd_set write_set;
     int max_fd;
-    client_t clients[FD_SETSIZE];
-    select_server_request requests[FD_SETSIZE];
+    select_server_request* requests[EXT_FD_SETSIZE]; // Indexed by socket; NULL if not connected
+    slab_t slab;
+    timer_wheel_t timers;  // The connections' deadlines
+    uint64_t now;          // timer_wheel_clock as of the last wakeup
     size_t connected_count;
 } select_server_client_set;
 
+/**
+ * Returns how long a connection may wait under one of its deadlines.
+ *
+ * @return Milliseconds, or 0 if the deadline is turned off.
+ */
+static uint64_t deadline_ms(stats_timeout kind)
+{
+    unsigned int seconds = kind == STATS_TIMEOUT_WRITE ? server_options.write_timeout :
+                           kind == STATS_TIMEOUT_HEADER ? server_options.header_timeout :
+                           server_options.idle_timeout;
+    return (uint64_t)seconds * 1000;
+}
+
+/**
+ * Sets the deadline that applies to the client now that it has been served: the write deadline while its
+ * echo is waiting for the socket, the header deadline once a size header has been started, and the idle
+ * deadline otherwise. A header has to be finished within its deadline of starting, the write deadline is
+ * pushed back by every send, and the idle deadline every time the client is served.
+ *
+ * @param set     The client set, which holds the timer wheel.
+ * @param request The client's request.
+ * @param conn    The rest of the client's connection.
+ */
+static void set_deadline(select_server_client_set* set, select_server_request* request, select_server_conn* conn)
+{
+    stats_timeout kind = STATS_TIMEOUT_IDLE;
+    int wrote = request->wrote;
+    request->wrote = 0;
+    if (request->frame.state == FRAME_WRITE_BODY)
+    {
+        kind = STATS_TIMEOUT_WRITE;
+        if (conn->deadline_kind == kind && !wrote)
+        {
+            return;
+        }
+    }
+    else if (request->frame.state == FRAME_READ_HEADER && request->frame.hdr_have > 0)
+    {
+        kind = STATS_TIMEOUT_HEADER;
+        if (conn->deadline_kind == kind && conn->deadline_messages == request->frame.messages)
+        {
+            // Still the same header
+            return;
+        }
+    }
+
+    conn->deadline_kind = (uint8_t)kind;
+    conn->deadline_messages = request->frame.messages;
+    uint64_t wait = deadline_ms(kind);
+    if (wait == 0)
+    {
+        timer_wheel_cancel(&set->timers, &conn->deadline);
+    }
+    else
+    {
+        timer_wheel_schedule(&set->timers, &conn->deadline, set->now + wait);
+    }
+}
+
+/**
+ * Closes a client and gives its slot back to the slab for the next one.
+ *
+ * @param set     The client set.
+ * @param sock    The client's socket.
+ * @param request The client's request.
+ * @param conn    The rest of the client's connection.
+ */
+static void close_client(select_server_client_set* set, int sock, select_server_request* request,
+                         select_server_conn* conn)
+{
+    --set->connected_count;
+    close(sock);
+    timer_wheel_cancel(&set->timers, &conn->deadline);
+    framer_free(&request->frame);
+
+    set->requests[sock] = NULL;
+    slab_free(&set->slab, request);
+}
+
+/**
+ * Closes a client that has missed its deadline. Called by the timer wheel.
+ *
+ * @param entry    The connection's deadline.
+ * @param void_set The client set.
+ */
+static void deadline_expired(timer_entry* entry, void* void_set)
+{
+    select_server_client_set* set = (select_server_client_set*)void_set;
+    select_server_conn* conn = (select_server_conn*)((char*)entry - offsetof(select_server_conn, deadline));
+    select_server_request* request = set->requests[conn->sock];
+
+    stats_timed_out((stats_timeout)conn->deadline_kind);
+    stats_connection_closed(-1);
+    if (server_options.verbose)
+    {
+        static char const* kind_names[STATS_NUM_TIMEOUTS] = { "idle", "header", "write" };
+        printf("Timed out (%s); total bytes transferred: %ld; peer: %s:%hu\n", kind_names[conn->deadline_kind],
+               request->frame.transferred, inet_ntoa(conn->peer.sin_addr), ntohs(conn->peer.sin_port));
+    }
+
+    close_client(set, conn->sock, request, conn);
+}
+
+/**
+ * Sends as much of the current echo as the socket will take. Whatever doesn't fit stays queued in the
+ * framer, and the select loop watches the socket for writability instead of readability until the
+ * echo has been sent.
+ *
+ * @param sock    The client's socket.
+ * @param request The client's request, whose framer holds the echo.
+ * @param conn    The rest of the client's connection.
+ * @return 0 on success, or -1 on failure.
+ */
+static int flush_response(int sock, select_server_request* request, select_server_conn* conn)
+{
+    framer_t* frame = &request->frame;
+    size_t len;
+    char const* out = framer_pending(frame, &len);
+    ssize_t bytes_sent = send_data(sock, out, len);
+    if (bytes_sent == -1)
+    {
+        return -1;
+    }
+    stats_bytes_sent((size_t)bytes_sent);
+    if ((size_t)bytes_sent < len)
+    {
+        stats_would_block(STATS_OP_SEND);
+    }
+    request->wrote |= bytes_sent > 0;
+    framer_sent(frame, (size_t)bytes_sent);
+    if (frame->state != FRAME_WRITE_BODY)
+    {
+        stats_messages_echoed(&conn->timer, frame->messages);
+    }
+    return 0;
+}
+
 /**
  * Handles a client request on the given socket.
  *
@@ -67,149 +230,131 @@ static int handle_request(server_t* server, int sock)
     // TODO: Try to remove some of the return paths
     select_server_client_set* set = (select_server_client_set*)server->private;
 
-    int index = sock; // To make things a bit less confusing
-    select_server_request* request = set->requests + index;
+    select_server_request* request = set->requests[sock];
+    select_server_conn* conn = slab_cold(&set->slab, request);
+    framer_t* frame = &request->frame;
 
     struct timeval start;
     gettimeofday(&start, NULL);
 
     int result = 0;
-    int would_block = 0;
-    do
+    int drained = 0; // Set once a recv comes up short, i.e. the socket has nothing more for now
+
+    if (frame->rbuf == NULL && framer_init(frame) == -1)
     {
-        int which_message = request->transferred / (request->msg_size + sizeof(request->msg_size));
-        size_t offset = request->transferred % (request->msg_size + sizeof(request->msg_size));
+        result = -1;
+        goto cleanup;
+    }
 
-        if (offset < sizeof(request->msg_size))
+    if (frame->state == FRAME_WRITE_BODY)
+    {
+        // Finish echoing before reading any more from the client
+        if (flush_response(sock, request, conn) == -1)
         {
-            // We're reading a message size
-            unsigned char* raw = ((unsigned char*)&request->partial_msg_size) + offset;
-            size_t bytes_left = sizeof(request->partial_msg_size) - offset;
-            ssize_t bytes_read = read_data(sock, raw, bytes_left);
-            if (bytes_read == -1)
-            {
-                result = -1;
-                goto cleanup;
-            }
-
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
-            {
-                request->msg_size = request->partial_msg_size;
-                if (request->msg_size == 0)
-                {
-                    // Client is finished sending data
-                    goto cleanup;
-                }
-                if (request->msg == NULL)
-                {
-                    request->msg = malloc(request->msg_size);
-                    if (!request->msg)
-                    {
-                        perror("malloc");
-                        result = -1;
-                        goto cleanup;
-                    }
-                }
-            }
+            result = -1;
+            goto cleanup;
         }
-        else
-        {
-            // We're reading message content
-            offset -= sizeof(request->msg_size);
-            size_t bytes_left = request->msg_size - offset;
-            ssize_t bytes_read = read_data(sock, request->msg, bytes_left);
+    }
 
-            if (bytes_read == -1)
+    while (frame->state != FRAME_WRITE_BODY && !atomic_load(&done))
+    {
+        int status = framer_parse(frame, 0);
+        if (status == FRAMES_ECHO)
+        {
+            if (flush_response(sock, request, conn) == -1)
             {
                 result = -1;
                 goto cleanup;
             }
+            continue;
+        }
+        else if (status == FRAMES_FINISHED)
+        {
+            goto cleanup;
+        }
+        else if (status == FRAMES_ERROR)
+        {
+            result = -1;
+            goto cleanup;
+        }
+        else if (drained)
+        {
+            break;
+        }
 
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
+        // Everything buffered has been parsed, so refill the buffer with as much as the socket holds
+        ssize_t bytes_read = framer_recv(frame, sock, &drained);
+        if (bytes_read == -1)
+        {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
             {
-                // We've received a full message; echo back to the client
-                ssize_t bytes_sent;
-                size_t send_bytes_left = (ssize_t)request->msg_size;
-                do
-                {
-                    bytes_sent = send_data(sock, request->msg + (request->msg_size - send_bytes_left), send_bytes_left);
-                    send_bytes_left -= bytes_sent;
-                } while(bytes_sent != -1 && send_bytes_left > 0);
-                
-                if (bytes_sent == -1)
-                {
-                    result = -1;
-                    goto cleanup;
-                }
+                stats_would_block(STATS_OP_RECV);
+                break;
             }
+            result = -1;
+            goto cleanup;
+        }
+        else if (bytes_read == 0)
+        {
+            // Client hung up without sending a zero size
+            goto cleanup;
         }
-    } while(!would_block && !atomic_load(&done));
+        stats_bytes_received((size_t)bytes_read);
+        stats_message_ready(&conn->timer);
+    }
 
     {
         struct timeval end;
         gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
+        conn->transfer_time += TIME_DIFF(start, end);
     }
 
+    set_deadline(set, request, conn);
     return 0;
 
 cleanup:
-    --set->connected_count;
     if (result == 0)
     {
         // Success, so write results to file
         struct timeval end;
         gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
-
-        unsigned short src_port = ntohs(set->clients[index].peer.sin_port);
-        char *addr = inet_ntoa(set->clients[index].peer.sin_addr);
-        char csv[256];
-        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request->transfer_time, request->transferred, addr, src_port);
-        log_msg(csv);
-
-        char pretty[256];
-        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
-                 request->transfer_time, request->transferred, addr, src_port);
-        printf("%s", pretty);
+        conn->transfer_time += TIME_DIFF(start, end);
+
+        transfer_log_append(&end, conn->transfer_time, frame->transferred, frame->messages, &conn->peer);
+        stats_connection_closed(conn->transfer_time);
+
+        if (server_options.verbose)
+        {
+            unsigned short src_port = ntohs(conn->peer.sin_port);
+            char *addr = inet_ntoa(conn->peer.sin_addr);
+            printf("Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+                   conn->transfer_time, frame->transferred, addr, src_port);
+        }
     }
     else
     {
         perror("oops!");
+        stats_connection_closed(-1);
     }
 
-    close(sock);
-    free(request->msg);
-
-    // Reset everything for the next client
-    request->msg = NULL;
-    request->msg_size = 0;
-    request->partial_msg_size = 0;
-    request->transferred = 0;
-    request->transfer_time = 0;
-    set->clients[index].sock = -1;
+    close_client(set, sock, request, conn);
     return result;
 }
 
-static void register_fds(fd_set* set, acceptor_t* acceptor, client_t* clients)
+static void register_fds(fd_set* set, fd_set* write_set, acceptor_t* acceptor, select_server_client_set* client_set)
 {
     memset(set, 0, sizeof(ext_fd_set));//FD_ZERO(set);
+    memset(write_set, 0, sizeof(ext_fd_set));
     FD_SET(acceptor->sock, set);
-    for (int i = 0; i < FD_SETSIZE; ++i)
+    FD_SET(done_signal_fd(), set);
+    FD_SET(done_event_fd(), set);
+    for (int i = 0; i <= client_set->max_fd; ++i)
     {
-        if(clients[i].sock != -1)
+        select_server_request* request = client_set->requests[i];
+        if (request != NULL)
         {
-            FD_SET(clients[i].sock, set);
+            // Clients with a queued echo aren't read from until it has been sent
+            FD_SET(i, request->frame.state == FRAME_WRITE_BODY ? write_set : set);
         }
     }
 }
@@ -226,63 +371,87 @@ static int select_server_start(server_t* server, acceptor_t* acceptor, int* hand
     }
 
     client_set->connected_count = 0;
+    if (slab_init(&client_set->slab, REQUEST_SLOT_SIZE, sizeof(select_server_conn)) == -1)
+    {
+        fprintf(stderr, "slab_init failed\n");
+        free(client_set);
+        return -1;
+    }
+    client_set->now = timer_wheel_clock();
+    timer_wheel_init(&client_set->timers, client_set->now);
 
-    // Set accept socket to non-blocking mode
-    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    if (acceptor_set_nonblocking(acceptor) == -1)
     {
-        perror("fnctl");
+        slab_destroy(&client_set->slab);
         free(client_set);
         return -1;
     }
+    acceptor->client_flags = SOCK_NONBLOCK;
 
     server->private = client_set;
 
-    for (int i = 0; i < FD_SETSIZE; ++i)
+    memset(client_set->requests, 0, sizeof(client_set->requests));
+    client_set->max_fd = acceptor->sock;
+    if (done_signal_fd() > client_set->max_fd || done_event_fd() > client_set->max_fd)
     {
-        client_set->clients[i].sock = -1;
+        client_set->max_fd = done_signal_fd() > done_event_fd() ? done_signal_fd() : done_event_fd();
     }
-
-    client_set->clients[acceptor->sock].sock = acceptor->sock;
-    client_set->max_fd = acceptor->sock;
-    memset(client_set->requests, 0, FD_SETSIZE * sizeof(select_server_request));
+    slab_print((slab_t* const[]){ &client_set->slab }, 1, stdout, "Connections", sizeof(select_server_request*));
 
     memset(&client_set->set, 0, sizeof(ext_fd_set));
     FD_SET(acceptor->sock, &client_set->set);
 
+    stats_thread_histograms();
+
     int num_selected;
-    while(!atomic_load(&done))
+    int err = 0;
+    while(!err && !atomic_load(&done))
     {
-        register_fds((fd_set*)&client_set->set, acceptor, client_set->clients);
+        register_fds((fd_set*)&client_set->set, (fd_set*)&client_set->write_set, acceptor, client_set);
         //fd_set read_fds = client_set->set;
+        // Sleep until the next deadline, or for good if there isn't one; shutdown comes in through done's fds
+        int wait = timer_wheel_timeout(&client_set->timers, client_set->now);
         struct timeval timeout;
-        timeout.tv_sec = 1;
-        num_selected = select(client_set->max_fd + 1, (fd_set*)&client_set->set, NULL, NULL, &timeout);
-        
+        timeout.tv_sec = wait / 1000;
+        timeout.tv_usec = (wait % 1000) * 1000;
+        num_selected = select(client_set->max_fd + 1, (fd_set*)&client_set->set, (fd_set*)&client_set->write_set,
+                              NULL, wait == -1 ? NULL : &timeout);
+        client_set->now = timer_wheel_clock();
+
         if (num_selected == -1)
         {
             if (errno != EINTR)
             {
                 perror("select");
+                err = 1;
+                break;
             }
-            break;
+            continue;
         }else if(num_selected == 0)
         {
-            printf("timed out\n");
+            timer_wheel_advance(&client_set->timers, client_set->now, deadline_expired, client_set);
             continue;
         }
 
+        if ((FD_ISSET(done_signal_fd(), &client_set->set) || FD_ISSET(done_event_fd(), &client_set->set)) &&
+            done_check())
+        {
+            break;
+        }
+
         // Check for new clients
         if(FD_ISSET(acceptor->sock, &client_set->set))
         {
-            // Continue accepting clients until we would block
-            int err = 0;
-            while(1)
+            // Continue accepting clients until we would block or run out of budget; the listener is
+            // level-triggered, so select will report any clients left over next time round
+            size_t budget = server_options.accept_budget ? server_options.accept_budget : ACCEPT_PER_ITER;
+            for (size_t i = 0; i < budget; ++i)
             {
                 client_t client;
                 int result = accept_client(acceptor, &client);
                 if (result == -1)
                 {
-                    if (errno != EWOULDBLOCK && errno != EAGAIN)
+                    if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR)
                     {
                         err = 1;
                     }
@@ -294,56 +463,69 @@ static int select_server_start(server_t* server, acceptor_t* acceptor, int* hand
                     {
                         err = 1;
                         break;
-                    }else{
-                        printf("addclient\n");
                     }
                 }
             }
         }
 
-        for (int i = acceptor->sock + 1; i < FD_SETSIZE; ++i)
+        for (int i = acceptor->sock + 1; i <= client_set->max_fd; ++i)
         {
             if (atomic_load(&done))
             {
                 break;
             }
 
-            if (client_set->clients[i].sock != -1 && FD_ISSET(client_set->clients[i].sock, &client_set->set))
+            if (client_set->requests[i] != NULL &&
+                (FD_ISSET(i, (fd_set*)&client_set->set) || FD_ISSET(i, (fd_set*)&client_set->write_set)))
             {
-                if (handle_request(server, client_set->clients[i].sock) == -1)
+                if (handle_request(server, i) == -1)
                 {
                     return -1;
                 }
             }
         }
+
+        timer_wheel_advance(&client_set->timers, client_set->now, deadline_expired, client_set);
     }
 
-    return (errno && errno != EINTR) * -1;
+    return err ? -1 : 0;
 }
 
 static int select_server_add_client(server_t* server, client_t client)
 {
     select_server_client_set* client_set = (select_server_client_set*)server->private;
-    
-    if (fcntl(client.sock, F_SETFL, O_NONBLOCK | fcntl(client.sock, F_GETFL, 0)) == -1)
+
+    if (client.sock >= EXT_FD_SETSIZE)
     {
-        perror("setsockopt");
-        return -1;
+        fprintf(stderr, "Socket %d is too big for select; closing it\n", client.sock);
+        close(client.sock);
+        stats_connection_rejected();
+        return 0;
     }
-    ++server->total_served;
-    ++client_set->connected_count;
-    if (client_set->connected_count > server->max_concurrent)
+
+    // Only this client is lost; the server carries on accepting
+    select_server_request* request = slab_alloc(&client_set->slab);
+    if (request == NULL)
     {
-        server->max_concurrent = client_set->connected_count;
+        perror("slab_alloc");
+        close(client.sock);
+        stats_connection_rejected();
+        return 0;
     }
+    select_server_conn* conn = slab_cold(&client_set->slab, request);
+    conn->peer = client.peer;
+    conn->sock = client.sock;
+    set_deadline(client_set, request, conn);
+
+    stats_connection_opened();
+    stats_connections_peak(++client_set->connected_count);
 
-    client_set->clients[client.sock] = client;
+    client_set->requests[client.sock] = request;
     if (client.sock > client_set->max_fd)
     {
         client_set->max_fd = client.sock;
     }
 
-
     return 0;
 }
 
@@ -351,15 +533,17 @@ static void select_server_cleanup(server_t* server)
 {
     select_server_client_set* client_set = (select_server_client_set*)server->private;
 
-    for (size_t i = 0; i < FD_SETSIZE; ++i)
+    for (int i = 0; i <= client_set->max_fd; ++i)
     {
-        if (client_set->clients[i].sock != -1)
+        if (client_set->requests[i] != NULL)
         {
-            // Technically we could just use i here, but w/e
-            close(client_set->clients[i].sock);
-            free(client_set->requests[i].msg);
+            close(i);
+            framer_free(&client_set->requests[i]->frame);
         }
     }
+
+    slab_print((slab_t* const[]){ &client_set->slab }, 1, stdout, "Connections", sizeof(select_server_request*));
+    slab_destroy(&client_set->slab);
     free(server->private);
 }
 
@@ -368,8 +552,6 @@ static server_t select_server_impl =
     select_server_start,
     select_server_add_client,
     select_server_cleanup,
-    0,
-    0,
     NULL
 };
 
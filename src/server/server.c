@@ -27,28 +27,26 @@ Name:			server.c
 #include "done.h"
 #include "acceptor.h"
 #include "server.h"
-#include "log.h"
+#include "options.h"
+#include "metrics.h"
+#include "placement.h"
+#include "stats.h"
+#include "transfer_log.h"
 
-static server_t* current_server; // The hacks just don't stop
-atomic_int done = 0;
-static __sig_atomic_t handled = 0;
-static void nonfatal_sighandler(int sig)
-{
-    atomic_store(&done, 1);
-    handled = 1;
-}
+server_options_t server_options = {0};
 
 static void fatal_sighandler(int sig)
 {
     static char final_message[256];
+    stats_counters totals;
+    stats_read(&totals, NULL, NULL);
     snprintf(final_message, 256, "Total served: %lu; Max concurrent connections: %lu\n",
-             current_server->total_served, current_server->max_concurrent);
+             (unsigned long)totals.opened, (unsigned long)totals.max_concurrent);
 
     fputs(final_message, stdout);
     fflush(stdout);
 
-    log_flush();
-    log_close();
+    transfer_log_close();
     exit(EXIT_FAILURE);
 }
 
@@ -73,24 +71,17 @@ FUNCTION
     Generic function used by the servers to connect to the client.
 
     Revisions:
-	(none)
+	2026-10-17 - SIGINT and SIGQUIT are read from done's signalfd instead of caught.
 
 *********************************************************************************************/
 int serve(server_t *server, unsigned short port)
 {
-    // >:(
-    current_server = server;
-
-    struct sigaction nonfatal_sa;
-    memset(&nonfatal_sa, 0, sizeof(struct sigaction));
-    nonfatal_sa.sa_handler = nonfatal_sighandler;
-    sigemptyset(&nonfatal_sa.sa_mask);
-
-    // Set up signal handlers so that we can interrupt system calls on signal
-    sigaction(SIGQUIT, &nonfatal_sa, 0);
-    sigaction(SIGINT, &nonfatal_sa, 0);
-    sigaction(SIGSTOP, &nonfatal_sa, 0);
- 
+    // Blocks SIGINT, SIGQUIT and SIGHUP before any thread is started, so that they're only ever seen through the signalfd
+    if (done_init() == -1)
+    {
+        return -1;
+    }
+
     struct sigaction fatal_sa;
     memset(&fatal_sa, 0, sizeof(struct sigaction));
     fatal_sa.sa_handler = fatal_sighandler;
@@ -107,91 +98,77 @@ int serve(server_t *server, unsigned short port)
     sigaction(SIGABRT, &fatal_sa, 0);
     sigaction(SIGTRAP, &fatal_sa, 0);
 
-    server->total_served = 0;
-    server->max_concurrent = 0;
-
     acceptor_t acceptor;
-
-    // Thanks Beej: http://beej.us/guide/bgnet/output/html/singlepage/bgnet.html#bind
-    struct addrinfo hints;
-
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_flags = AI_PASSIVE;
-
-    // TODO: Just pass in the port string from argv instead of this nonsense
-    char buf[5] = {0};
-    snprintf(buf, 5, "%hu", port);
-    if (getaddrinfo(NULL, buf, &hints, &acceptor.info) < 0)
+    if (acceptor_open(&acceptor, port, server_options.reuse_port) == -1)
     {
-        perror("getaddrinfo");
+        done_cleanup();
         return -1;
     }
 
-    acceptor.port = port;
-    acceptor.sock = socket(acceptor.info->ai_family, acceptor.info->ai_socktype, acceptor.info->ai_protocol);
-    if (acceptor.sock < 0)
+    if (stats_start(server_options.report_interval) == -1)
     {
-        perror("socket");
-        freeaddrinfo(acceptor.info);
-        return -1;
-    }
-
-    int reuse = 1;
-    if (setsockopt(acceptor.sock, SOL_SOCKET, SO_REUSEADDR, &reuse, (socklen_t)sizeof(reuse)) < 0)
-    {
-        // This isn't a fatal error, so just print the error message and carry on
-        perror("setsockopt");
-    }
-
-    if (bind(acceptor.sock, acceptor.info->ai_addr, acceptor.info->ai_addrlen) < 0)
-    {
-        perror("bind");
         cleanup_acceptor(&acceptor);
+        done_cleanup();
         return -1;
     }
 
-    if (listen(acceptor.sock, 256) == -1)
+    if (server_options.metrics_address != NULL && metrics_start(server_options.metrics_address) == -1)
     {
-        perror("listen");
+        stats_stop();
         cleanup_acceptor(&acceptor);
+        done_cleanup();
         return -1;
     }
 
+    // Pinned after the side threads are started so that they don't inherit this thread's CPU; any thread
+    // the server starts does, until it pins itself
+    placement_pin("Main thread", 0);
+
     int handles_accept;
     if (server->start(server, &acceptor, &handles_accept) == -1)
     {
         perror("server->start");
+        done_set();
+        metrics_stop();
+        stats_stop();
         return -1;
     }
 
-    if (!handles_accept)
+    if (!handles_accept && acceptor_set_nonblocking(&acceptor) == 0)
     {
-        // TODO: Need to find a way to set done in the handles_accept case (i.e. every case)
         while(1)
         {
             client_t client;
-            if (accept_client(&acceptor, &client) == -1)
+            if (accept_client_wait(&acceptor, &client) == -1)
             {
-                atomic_store(&done, 1);
+                done_set();
                 break;
             }
             else
             {
+                // A client the server can't take is closed by the server; the rest are still worth accepting
                 server->add_client(server, client);
             }
         }
     }
 
+    // Also wakes any threads the server still has running
+    done_set();
     server->cleanup(server);
+    metrics_stop();
+    stats_stop();
+    done_cleanup();
+
+    stats_counters totals;
+    stats_read(&totals, NULL, NULL);
+    acceptor_print_stats(&acceptor, totals.setup_calls);
     cleanup_acceptor(&acceptor);
 
-    if (handled)
+    if (done_by_signal())
     {
         printf("Caught signal; exiting.\n");
         fflush(stdout);
     }
 
-    return handled ? 0 : -1;
+    return done_by_signal() ? 0 : -1;
 }
\ No newline at end of file
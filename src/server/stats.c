@@ -0,0 +1,765 @@
+/*********************************************************************************************
+Name:			stats.c
+
+    Required:	stats.h
+                counters.h
+                histogram.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Live server stats and the console reporter. The counters only ever go up; the reporter
+    keeps the values it saw last time and prints the difference, so the servers never have
+    to coordinate with it. The counters are sharded per thread. The event loops each record
+    into histograms of their own, which are merged whenever the stats are read; the thread
+    server's workers share one set, since a copy each would cost 60 KB for every worker.
+
+    Revisions:
+    2026-10-17 - Event loops record their times in histograms of their own.
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "counters.h"
+#include "histogram.h"
+#include "stats.h"
+#include "timing.h"
+
+enum
+{
+    COUNTER_OPENED,
+    COUNTER_CLOSED,
+    COUNTER_REJECTED,
+    COUNTER_BYTES_RECEIVED,
+    COUNTER_BYTES_SENT,
+    COUNTER_MESSAGES,
+    COUNTER_WOULD_BLOCK,                                // One per stats_op
+    COUNTER_SETUP_CALLS = COUNTER_WOULD_BLOCK + STATS_NUM_OPS,
+    COUNTER_MAX_CONCURRENT,                             // Kept with counters_raise
+    COUNTER_TIMED_OUT,                                  // One per stats_timeout
+    NUM_COUNTERS = COUNTER_TIMED_OUT + STATS_NUM_TIMEOUTS
+};
+
+static counters_t counters = COUNTERS_INITIALIZER(NUM_COUNTERS);
+
+/**
+ * A set of time histograms. Once a thread has its own, it's kept until the process exits, so the totals
+ * printed after the servers have been cleaned up still include it.
+ */
+typedef struct stats_histograms stats_histograms;
+struct stats_histograms
+{
+    histogram_t transfer_times; // Microseconds
+    histogram_t service_times;  // Microseconds
+    stats_histograms* next;     // Set before the set is pushed onto the list
+};
+
+static stats_histograms shared_histograms;
+static _Atomic(stats_histograms*) thread_histograms; // Only ever pushed onto
+static _Thread_local stats_histograms* histograms = &shared_histograms;
+
+static pthread_t reporter;
+static int reporter_running;
+static int stopping; // Guarded by stop_lock
+static pthread_mutex_t stop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop_cond;
+
+/**
+ * Everything the reporter needs to remember from one report to the next.
+ */
+typedef struct
+{
+    struct timespec at;
+    size_t opened;
+    size_t closed;
+    uint64_t bytes;
+    histogram_t transfer_times;
+} stats_snapshot;
+
+/**
+ * Adds up one kind of histogram from every set into out.
+ *
+ * @param out     Set to the sum.
+ * @param service Whether to add up the service times rather than the transfer times.
+ */
+static void merge_histograms(histogram_t* out, int service)
+{
+    histogram_snapshot(service ? &shared_histograms.service_times : &shared_histograms.transfer_times, out);
+    for (stats_histograms* set = atomic_load(&thread_histograms); set != NULL; set = set->next)
+    {
+        histogram_add(out, service ? &set->service_times : &set->transfer_times);
+    }
+}
+
+static void take_snapshot(stats_snapshot* snapshot)
+{
+    clock_gettime(CLOCK_MONOTONIC, &snapshot->at);
+    snapshot->closed = counters_sum(&counters, COUNTER_CLOSED);
+    snapshot->opened = counters_sum(&counters, COUNTER_OPENED);
+    snapshot->bytes = counters_sum(&counters, COUNTER_BYTES_RECEIVED);
+    merge_histograms(&snapshot->transfer_times, 0);
+}
+
+/**
+ * Prints the activity between two snapshots. Intervals in which nothing happened and no clients were
+ * connected are skipped.
+ */
+static void report(stats_snapshot const* last, stats_snapshot const* now)
+{
+    static histogram_t interval_times;
+
+    // Closed is read before opened, but a server may count a connection as closed before it gets around to
+    // counting it as opened
+    size_t active = now->opened > now->closed ? now->opened - now->closed : 0;
+    size_t finished = now->closed - last->closed;
+    uint64_t received = now->bytes - last->bytes;
+    if (active == 0 && finished == 0 && received == 0 && now->opened == last->opened)
+    {
+        return;
+    }
+
+    double elapsed = (double)(now->at.tv_sec - last->at.tv_sec) + (now->at.tv_nsec - last->at.tv_nsec) / 1e9;
+    printf("%.0f conn/s; %.2f MB/s; %zu active", finished / elapsed, received / elapsed / 1e6, active);
+
+    histogram_snapshot(&now->transfer_times, &interval_times);
+    histogram_subtract(&interval_times, &last->transfer_times);
+    if (histogram_count(&interval_times) > 0)
+    {
+        printf("; transfer time p50 %luus, p99 %luus",
+               (unsigned long)histogram_percentile(&interval_times, 50.0),
+               (unsigned long)histogram_percentile(&interval_times, 99.0));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void* reporter_func(void* arg)
+{
+    unsigned int interval = *(unsigned int*)arg;
+
+    // Two snapshots, each about 30 KB, so keep them off the thread's stack
+    static stats_snapshot snapshots[2];
+    stats_snapshot* last = &snapshots[0];
+    stats_snapshot* now = &snapshots[1];
+    take_snapshot(last);
+
+    struct timespec wake = last->at;
+    pthread_mutex_lock(&stop_lock);
+    while (!stopping)
+    {
+        wake.tv_sec += interval;
+        while (!stopping && pthread_cond_timedwait(&stop_cond, &stop_lock, &wake) != ETIMEDOUT);
+        if (stopping)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&stop_lock);
+
+        take_snapshot(now);
+        report(last, now);
+
+        stats_snapshot* swap = last;
+        last = now;
+        now = swap;
+
+        pthread_mutex_lock(&stop_lock);
+    }
+    pthread_mutex_unlock(&stop_lock);
+
+    return NULL;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_connection_opened
+
+    Prototype:	void stats_connection_opened(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    Counts a newly accepted connection.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_connection_opened(void)
+{
+    counters_add(&counters, COUNTER_OPENED, 1);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_connections_peak
+
+    Prototype:	void stats_connections_peak(size_t connected)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    connected - the number of connections open now.
+
+    Return Values:
+
+    Description:
+    Raises the calling thread's high-water mark; stats_read reports the highest of them.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_connections_peak(size_t connected)
+{
+    counters_raise(&counters, COUNTER_MAX_CONCURRENT, connected);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_active_connections
+
+    Prototype:	size_t stats_active_connections(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    The number of connections opened and not yet closed.
+
+    Description:
+    Reads closed first, so a connection that has been counted as closed has always been
+    counted as opened too. A server may close a connection before it gets around to
+    counting it as opened, though, so the difference is clamped at zero.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+size_t stats_active_connections(void)
+{
+    uint64_t closed = counters_sum(&counters, COUNTER_CLOSED);
+    uint64_t opened = counters_sum(&counters, COUNTER_OPENED);
+    return opened > closed ? (size_t)(opened - closed) : 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_setup_calls
+
+    Prototype:	void stats_setup_calls(size_t count)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    count - the number of system calls.
+
+    Return Values:
+
+    Description:
+    Counts system calls made setting up accepted clients, for acceptor_print_stats.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_setup_calls(size_t count)
+{
+    counters_add(&counters, COUNTER_SETUP_CALLS, count);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_connection_closed
+
+    Prototype:	void stats_connection_closed(time_t transfer_time)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    transfer_time - microseconds spent serving the connection, or -1 if it failed.
+
+    Return Values:
+
+    Description:
+    Records the transfer time, then counts the connection as closed. The order matters: the
+    reporter reads closed first, so it never sees more connections closed than opened.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_connection_closed(time_t transfer_time)
+{
+    if (transfer_time >= 0)
+    {
+        histogram_record(&histograms->transfer_times, (uint64_t)transfer_time);
+    }
+    counters_add(&counters, COUNTER_CLOSED, 1);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_connection_rejected
+
+    Prototype:	void stats_connection_rejected(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    Counts an accepted connection that was closed without being served.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_connection_rejected(void)
+{
+    counters_add(&counters, COUNTER_REJECTED, 1);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_bytes_received
+
+    Prototype:	void stats_bytes_received(size_t count)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    count - the number of bytes.
+
+    Return Values:
+
+    Description:
+    Adds to the bytes received from clients.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_bytes_received(size_t count)
+{
+    counters_add(&counters, COUNTER_BYTES_RECEIVED, count);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_bytes_sent
+
+    Prototype:	void stats_bytes_sent(size_t count)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    count - the number of bytes.
+
+    Return Values:
+
+    Description:
+    Adds to the bytes sent to clients.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_bytes_sent(size_t count)
+{
+    counters_add(&counters, COUNTER_BYTES_SENT, count);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_would_block
+
+    Prototype:	void stats_would_block(stats_op op)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    op - the operation that would have blocked.
+
+    Return Values:
+
+    Description:
+    Counts an EWOULDBLOCK (or short send) for the operation.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_would_block(stats_op op)
+{
+    counters_add(&counters, COUNTER_WOULD_BLOCK + op, 1);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_timed_out
+
+    Prototype:	void stats_timed_out(stats_timeout kind)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    kind - the deadline the connection missed.
+
+    Return Values:
+
+    Description:
+    Counts a connection closed for missing a deadline.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_timed_out(stats_timeout kind)
+{
+    counters_add(&counters, COUNTER_TIMED_OUT + kind, 1);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_message_ready
+
+    Prototype:	void stats_message_ready(stats_timer* timer)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    timer - the connection's timer.
+
+    Return Values:
+
+    Description:
+    Stamps the time of the read. Messages completed by it and echoed later, including ones
+    queued behind an earlier echo, are timed from here.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_message_ready(stats_timer* timer)
+{
+    gettimeofday(&timer->ready, NULL);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_messages_echoed
+
+    Prototype:	void stats_messages_echoed(stats_timer* timer, uint32_t messages)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    timer - the connection's timer.
+    messages - the number of messages the connection has echoed in all.
+
+    Return Values:
+
+    Description:
+    Echoes of several messages are often sent together, so they all get the time since the
+    last read.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_messages_echoed(stats_timer* timer, uint32_t messages)
+{
+    uint32_t count = messages - timer->timed;
+    if (count == 0)
+    {
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    time_t service_time = TIME_DIFF(timer->ready, now);
+    histogram_record_n(&histograms->service_times, service_time > 0 ? (uint64_t)service_time : 0, count);
+    counters_add(&counters, COUNTER_MESSAGES, count);
+    timer->timed = messages;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_thread_histograms
+
+    Prototype:	void stats_thread_histograms(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    Allocates the calling thread a set of histograms and pushes it onto the list that
+    merge_histograms walks. If there's no memory, the thread keeps using the shared set.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_thread_histograms(void)
+{
+    if (histograms != &shared_histograms)
+    {
+        return;
+    }
+
+    stats_histograms* set = calloc(1, sizeof(stats_histograms));
+    if (set == NULL)
+    {
+        perror("malloc histograms");
+        return;
+    }
+
+    set->next = atomic_load(&thread_histograms);
+    while (!atomic_compare_exchange_weak(&thread_histograms, &set->next, set));
+    histograms = set;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_start
+
+    Prototype:	int stats_start(unsigned int interval)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    interval - seconds between reports, or 0 for no reports.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Starts the reporter thread. It waits on a condition variable against the monotonic
+    clock so that stats_stop doesn't have to wait out the rest of an interval.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int stats_start(unsigned int interval)
+{
+    static unsigned int reporter_interval;
+    if (interval == 0)
+    {
+        return 0;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stop_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    stopping = 0;
+    reporter_interval = interval;
+
+    int err = pthread_create(&reporter, NULL, reporter_func, &reporter_interval);
+    if (err != 0)
+    {
+        errno = err;
+        perror("pthread_create");
+        pthread_cond_destroy(&stop_cond);
+        return -1;
+    }
+
+    reporter_running = 1;
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_stop
+
+    Prototype:	void stats_stop(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+
+    Description:
+    Tells the reporter to stop and joins it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void stats_stop(void)
+{
+    if (!reporter_running)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&stop_lock);
+    stopping = 1;
+    pthread_cond_signal(&stop_cond);
+    pthread_mutex_unlock(&stop_lock);
+
+    pthread_join(reporter, NULL);
+    pthread_cond_destroy(&stop_cond);
+    reporter_running = 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_read
+
+    Prototype:	void stats_read(stats_counters* totals, histogram_t* service_copy,
+                                histogram_t* transfer_copy)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    totals - set to the running totals.
+    service_copy - set to the service times, unless NULL.
+    transfer_copy - set to the transfer times, unless NULL.
+
+    Return Values:
+
+    Description:
+    Reads everything without stopping the servers, so the numbers may be a few updates
+    apart from each other, but closed is still read before opened.
+
+    Revisions:
+	2026-10-17 - Merge every thread's histograms into the copies.
+
+*********************************************************************************************/
+void stats_read(stats_counters* totals, histogram_t* service_copy, histogram_t* transfer_copy)
+{
+    totals->closed = counters_sum(&counters, COUNTER_CLOSED);
+    totals->opened = counters_sum(&counters, COUNTER_OPENED);
+    totals->rejected = counters_sum(&counters, COUNTER_REJECTED);
+    totals->bytes_received = counters_sum(&counters, COUNTER_BYTES_RECEIVED);
+    totals->bytes_sent = counters_sum(&counters, COUNTER_BYTES_SENT);
+    totals->messages = counters_sum(&counters, COUNTER_MESSAGES);
+    for (int op = 0; op < STATS_NUM_OPS; ++op)
+    {
+        totals->would_block[op] = counters_sum(&counters, COUNTER_WOULD_BLOCK + op);
+    }
+    totals->setup_calls = counters_sum(&counters, COUNTER_SETUP_CALLS);
+    totals->max_concurrent = counters_max(&counters, COUNTER_MAX_CONCURRENT);
+    for (int kind = 0; kind < STATS_NUM_TIMEOUTS; ++kind)
+    {
+        totals->timed_out[kind] = counters_sum(&counters, COUNTER_TIMED_OUT + kind);
+    }
+
+    if (service_copy != NULL)
+    {
+        merge_histograms(service_copy, 1);
+    }
+    if (transfer_copy != NULL)
+    {
+        merge_histograms(transfer_copy, 0);
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		stats_print_totals
+
+    Prototype:	void stats_print_totals(char const* name)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    name - the file in which to save the service time histogram.
+
+    Return Values:
+
+    Description:
+    Prints a line of percentiles for each histogram and writes out the service times, which
+    can be merged with other runs' using the histogram-merge tool.
+
+    Revisions:
+	2026-10-17 - Merge every thread's histograms first.
+
+*********************************************************************************************/
+void stats_print_totals(char const* name)
+{
+    // About 30 KB each, so kept off the stack
+    static histogram_t service_times;
+    static histogram_t transfer_times;
+    merge_histograms(&service_times, 1);
+    merge_histograms(&transfer_times, 0);
+
+    histogram_print(&service_times, stdout, "Service time", "us");
+    histogram_print(&transfer_times, stdout, "Connection transfer time", "us");
+    histogram_write(&service_times, name);
+}
@@ -21,53 +21,313 @@ Name:			thread_server.c
 
 *********************************************************************************************/
 
+#define _GNU_SOURCE // eventfd under -std=c11
+
+#include <assert.h>
+#include <errno.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <client.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include <vector.h>
 #include <arpa/inet.h>
 
-#include "log.h"
+#include "buffer_pool.h"
+#include "transfer_log.h"
 #include "timing.h"
 #include "vector.h"
 #include "ring_buffer.h"
 #include "done.h"
+#include "futex.h"
+#include "options.h"
+#include "placement.h"
 #include "server.h"
+#include "stats.h"
 #include "protocol.h"
 
-static const unsigned int WORKER_POOL_SIZE = 200;
+// How long an idle worker spins before parking, in pause instructions. Each worker adapts its own limit:
+// doubled when a client turns up while it's spinning, halved when it has to park
+#define WORKER_SPIN_MIN 64
+#define WORKER_SPIN_MAX 16384
 
-#define CLIENT_BACKLOG_SIZE 100
-static client_t client_backlog_buf[CLIENT_BACKLOG_SIZE];
+// Clients accepted while every worker is busy and the pool is at its maximum; once it fills, the rest wait in
+// the listener's backlog
+#define CLIENT_BACKLOG_SIZE 128
 
 typedef struct
 {
     client_stats_t stats;
     uint32_t msg_size;
+    uint32_t messages;
+    stats_timer timer;
     char* msg;
 } thread_server_request;
 
-typedef struct
+// A worker's state, which is also the word it parks on
+enum
 {
-    atomic_int busy;
-    client_t client;
-} worker_params;
+    WORKER_IDLE,    // Spinning, waiting for a client
+    WORKER_PARKED,  // Asleep in futex_wait; whoever moves it out of this state wakes it
+    WORKER_BUSY,    // Serving params->client
+    WORKER_STOPPED, // Told to exit by thread_server_cleanup
+    WORKER_RETIRED  // Parked for longer than the idle limit and exited; left for the accept thread to forget
+};
 
-typedef struct
+typedef struct worker_params worker_params;
+typedef struct thread_server_private thread_server_private;
+
+struct worker_params
 {
-    vector_t worker_params_list;
-    ring_buffer_t client_backlog;
-    pthread_mutex_t stdout_guard;
-} thread_server_private;
+    atomic_int state;
+    atomic_int refs;                // Held by the worker and by the worker list; the last one to let go frees the params
+    client_t client;                // Only written by the accept thread, while the worker is idle or parked
+    size_t index;                   // Order in which the worker was started, for placement_pin
+    size_t slot;                    // Position in the worker list
+    worker_params* next_idle;       // Below this worker on the idle stack
+    thread_server_private* pool;
+};
+
+struct thread_server_private
+{
+    // Only the accept thread touches these
+    vector_t worker_params_list;    // Every worker that hasn't been forgotten, for cleanup
+    size_t num_workers;             // Its size, which max_workers caps
+    size_t next_index;
+
+    ring_buffer_t client_backlog;   // Filled by the accept thread, and emptied by it and by workers as they free up
+
+    _Atomic(worker_params*) idle;   // Workers waiting for a client, most recently finished on top
+    atomic_size_t num_kept;         // Workers that haven't decided to retire, which min_workers is a floor for
+    atomic_int reap_pending;        // Set by a worker that has retired
+    atomic_int accept_waiting;      // Set by the accept thread while it waits for room in the backlog
+    atomic_size_t refs;             // Held by the server and every running worker; the last one to let go frees the pool
+    int wake_fd;                    // Wakes the accept thread for a retired worker or a backlog that can move
+
+    size_t min_workers;
+    size_t max_workers;
+    unsigned int idle_ms;           // How long a parked worker waits before retiring; 0 for never
+};
 
 static int thread_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
 static int thread_server_add_client(server_t* server, client_t client);
 static void thread_server_cleanup(server_t* server);
 
+/**
+ * Drops one of the two references to a worker's params.
+ */
+static void worker_release(worker_params* params)
+{
+    if (atomic_fetch_sub(&params->refs, 1) == 1)
+    {
+        free(params);
+    }
+}
+
+/**
+ * Drops a reference to the pool.
+ */
+static void pool_release(thread_server_private* pool)
+{
+    if (atomic_fetch_sub(&pool->refs, 1) == 1)
+    {
+        ring_buffer_free(&pool->client_backlog);
+        close(pool->wake_fd);
+        free(pool);
+    }
+}
+
+/**
+ * Wakes the accept thread if it's waiting.
+ */
+static void pool_wake(thread_server_private* pool)
+{
+    uint64_t one = 1;
+    if (write(pool->wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+    {
+        perror("write eventfd");
+    }
+}
+
+/**
+ * Pushes a worker onto the idle stack. Called by the worker itself once it has finished with a client (or
+ * by worker_spawn for the initial workers). Sequentially consistent, so that a worker that then finds the
+ * backlog empty can't miss the accept thread queueing a client without seeing this worker on the stack.
+ */
+static void idle_push(worker_params* params)
+{
+    _Atomic(worker_params*)* idle = &params->pool->idle;
+    worker_params* top = atomic_load_explicit(idle, memory_order_relaxed);
+    do
+    {
+        params->next_idle = top;
+    } while (!atomic_compare_exchange_weak(idle, &top, params));
+}
+
+/**
+ * Pops the most recently idled worker, whose stack and cache are the likeliest to still be warm. Only the
+ * accept thread pops, so a worker can't be popped, served and pushed again between this thread reading the
+ * top and swapping it out, which is what makes the stack safe without ABA counters.
+ *
+ * @return The worker, or NULL if every worker is busy.
+ */
+static worker_params* idle_pop(thread_server_private* private)
+{
+    worker_params* top = atomic_load_explicit(&private->idle, memory_order_acquire);
+    while (top != NULL && !atomic_compare_exchange_weak_explicit(&private->idle, &top, top->next_idle,
+                                                                 memory_order_acquire, memory_order_acquire));
+    return top;
+}
+
+/**
+ * Drops a retired worker from the worker list, making room under max_workers for a new one. Only called by
+ * the accept thread.
+ */
+static void worker_forget(thread_server_private* private, worker_params* params)
+{
+    worker_params** list = (worker_params**)private->worker_params_list.items;
+    worker_params* last = list[private->worker_params_list.size - 1];
+    list[params->slot] = last;
+    last->slot = params->slot;
+    --private->worker_params_list.size;
+    --private->num_workers;
+    worker_release(params);
+}
+
+/**
+ * Forgets every retired worker on the idle stack, if any worker has retired since the last sweep. The stack is
+ * taken whole, so workers that go idle in the meantime push onto an empty one, and the live workers are put
+ * back underneath them.
+ */
+static void reap_retired(thread_server_private* private)
+{
+    if (!atomic_load_explicit(&private->reap_pending, memory_order_relaxed) ||
+        !atomic_exchange(&private->reap_pending, 0))
+    {
+        return;
+    }
+
+    worker_params* top = atomic_exchange(&private->idle, NULL);
+    worker_params* live = NULL;
+    worker_params* live_bottom = NULL;
+    while (top != NULL)
+    {
+        worker_params* next = top->next_idle;
+        if (atomic_load(&top->state) == WORKER_RETIRED)
+        {
+            worker_forget(private, top);
+        }
+        else
+        {
+            if (live == NULL)
+            {
+                live = top;
+            }
+            else
+            {
+                live_bottom->next_idle = top;
+            }
+            live_bottom = top;
+        }
+        top = next;
+    }
+
+    if (live != NULL)
+    {
+        worker_params* pushed = atomic_load(&private->idle);
+        do
+        {
+            live_bottom->next_idle = pushed;
+        } while (!atomic_compare_exchange_weak(&private->idle, &pushed, live));
+    }
+}
+
+/**
+ * Retires a worker whose idle limit has passed, unless that would leave fewer than min_workers. Its place in
+ * num_kept is given up first, so that workers timing out together can't all see room to go. The worker stays
+ * on the idle stack and in max_workers' count until the accept thread forgets it.
+ *
+ * @return Non-zero if the worker is to exit.
+ */
+static int worker_try_retire(worker_params* params)
+{
+    thread_server_private* pool = params->pool;
+    size_t kept = atomic_load(&pool->num_kept);
+    do
+    {
+        if (kept <= pool->min_workers)
+        {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&pool->num_kept, &kept, kept - 1));
+
+    // Loses to the accept thread handing it a client
+    int expected = WORKER_PARKED;
+    if (!atomic_compare_exchange_strong(&params->state, &expected, WORKER_RETIRED))
+    {
+        atomic_fetch_add(&pool->num_kept, 1);
+        return 0;
+    }
+
+    atomic_store(&pool->reap_pending, 1);
+    pool_wake(pool);
+    return 1;
+}
+
+/**
+ * Waits for the accept thread to hand the worker a client: spins for up to *spin pauses, then parks. Spinning
+ * keeps hand-off latency down while clients are arriving faster than workers finish, and parking keeps
+ * idle workers off the CPU the rest of the time. A worker parked for longer than the pool's idle limit
+ * retires.
+ *
+ * @param params The worker's params.
+ * @param spin   The worker's spin limit, which is adapted to how often spinning pays off.
+ * @return Non-zero if the worker has a client, or 0 if it has been stopped or has retired.
+ */
+static int wait_for_client(worker_params* params, unsigned int* spin)
+{
+    for (unsigned int i = 0; i < *spin; ++i)
+    {
+        int state = atomic_load_explicit(&params->state, memory_order_acquire);
+        if (state != WORKER_IDLE)
+        {
+            if (*spin < WORKER_SPIN_MAX)
+            {
+                *spin *= 2;
+            }
+            return state == WORKER_BUSY;
+        }
+        futex_cpu_relax();
+    }
+
+    if (*spin > WORKER_SPIN_MIN)
+    {
+        *spin /= 2;
+    }
+
+    int expected = WORKER_IDLE;
+    if (atomic_compare_exchange_strong(&params->state, &expected, WORKER_PARKED))
+    {
+        unsigned int idle_ms = params->pool->idle_ms;
+        while ((expected = atomic_load(&params->state)) == WORKER_PARKED)
+        {
+            if (idle_ms == 0)
+            {
+                futex_wait(&params->state, WORKER_PARKED);
+            }
+            else if (futex_wait_for(&params->state, WORKER_PARKED, idle_ms) == -1 && worker_try_retire(params))
+            {
+                return 0;
+            }
+        }
+    }
+    return expected == WORKER_BUSY;
+}
+
 /*********************************************************************************************
 FUNCTION
 
@@ -86,32 +346,30 @@ FUNCTION
 	
     Description:
     Serves a single client request at a time, indicating to the main thread when it is no longer
-    busy.
+    busy. A worker that finishes while clients are waiting in the backlog takes the next one
+    itself.
 
     Revisions:
-	(none)
+	2026-10-17 - Park idle workers on a futex after a short adaptive spin instead of busy waiting.
+	2026-10-17 - Retire workers that stay parked for longer than the idle limit.
+	2026-10-17 - Take backlogged clients straight off the queue.
 
 *********************************************************************************************/
 static void* worker_func(void* void_params)
 {
     worker_params* params = (worker_params*)void_params;
+    placement_pin(NULL, params->index);
 
-    // Busy wait for a socket or done ;)
-    // If we cared about the threaded implementation, use of a conditional variable/eventfd would probably be a good
-    // way to make it better
-    while (1)
+    unsigned int spin = WORKER_SPIN_MIN;
+    int has_client = wait_for_client(params, &spin);
+    while (has_client)
     {
-        int done_local;
-        while(!atomic_load(&params->busy) && !(done_local = atomic_load(&done)));
-        if (done_local)
-        {
-            break;
-        }
-
         // Handle the new client
         thread_server_request request;
         request.stats.transferred = 0;
         request.stats.transfer_time = 0;
+        request.messages = 0;
+        request.timer.timed = 0;
 
         struct timeval start, end;
         gettimeofday(&start, NULL);
@@ -119,115 +377,302 @@ static void* worker_func(void* void_params)
         ssize_t read_result = read_data(params->client.sock, &request.msg_size, sizeof(request.msg_size));
         if (read_result == -1)
         {
-            atomic_store(&done, 1);
+            done_set();
             break;
         }
-        else if (read_result != 0) // We should actually always receive > 0 the first time, but who knows
+        request.stats.transferred += sizeof(request.msg_size);
+        stats_bytes_received(sizeof(request.msg_size));
+        request.msg = NULL;
+
+        // Continue reading from the client until we get size == 0 (or it hangs up)
+        while (read_result > 0 && request.msg_size != 0)
         {
-            request.msg = malloc(request.msg_size);
-            if (request.msg == NULL)
+            // Messages can grow from one to the next, so make sure the buffer still fits
+            char* msg = buffer_pool_reserve(request.msg, request.msg_size);
+            if (msg == NULL)
             {
-                atomic_store(&done, 1);
-                close(params->client.sock);
+                perror("buffer_pool_reserve");
                 break;
             }
-        }
-        request.stats.transferred += sizeof(request.msg_size);
+            request.msg = msg;
 
-        // Continue reading from the client until we get size == 0
-        while(1)
-        {
             // Read all data, send it, then read the next message size
             read_data(params->client.sock, request.msg, request.msg_size);
-            send_data(params->client.sock, request.msg, request.msg_size);
-            read_data(params->client.sock, &request.msg_size, sizeof(request.msg_size));
-
-            request.stats.transferred += sizeof(request.msg_size);
-            request.stats.transferred += request.msg_size;
-
-            if (request.msg_size == 0)
+            stats_message_ready(&request.timer);
+            ssize_t sent = send_data(params->client.sock, request.msg, request.msg_size);
+            if (sent > 0)
             {
-                break;
+                stats_bytes_sent((size_t)sent);
             }
+            request.stats.transferred += request.msg_size;
+            stats_bytes_received(request.msg_size);
+            ++request.messages;
+            stats_messages_echoed(&request.timer, request.messages);
+
+            read_result = read_data(params->client.sock, &request.msg_size, sizeof(request.msg_size));
+            request.stats.transferred += sizeof(request.msg_size);
+            stats_bytes_received(sizeof(request.msg_size));
         }
 
-        free(request.msg);
+        buffer_pool_free(request.msg);
         close(params->client.sock);
 
         gettimeofday(&end, NULL);
         request.stats.transfer_time = TIME_DIFF(start, end);
 
-        unsigned short src_port = ntohs(params->client.peer.sin_port);
-        char addr_buf[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &params->client.peer.sin_addr, addr_buf, INET_ADDRSTRLEN);
+        transfer_log_append(&end, request.stats.transfer_time, request.stats.transferred, request.messages,
+                            &params->client.peer);
+        stats_connection_closed(request.stats.transfer_time);
 
-        char csv[256];
-        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
-        log_msg(csv);
+        if (server_options.verbose)
+        {
+            // A single printf call is written out whole, so threads don't need to take turns
+            unsigned short src_port = ntohs(params->client.peer.sin_port);
+            char addr_buf[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &params->client.peer.sin_addr, addr_buf, INET_ADDRSTRLEN);
+            printf("Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+                   request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
+        }
 
-        char pretty[256];
-        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
-                 request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
+        // Stays busy, without a round trip through the accept thread
+        if (atomic_load(&params->state) == WORKER_BUSY &&
+            ring_buffer_try_get(&params->pool->client_backlog, &params->client) == 0)
+        {
+            // Ordered after the get, against the accept thread setting the flag and then counting again
+            atomic_thread_fence(memory_order_seq_cst);
+            if (atomic_load_explicit(&params->pool->accept_waiting, memory_order_relaxed) &&
+                atomic_exchange(&params->pool->accept_waiting, 0))
+            {
+                pool_wake(params->pool);
+            }
+            continue;
+        }
 
-        pthread_mutex_t* stdout_guard = &((thread_server_private*)thread_server->private)->stdout_guard;
-        pthread_mutex_lock(stdout_guard);
-        printf("%s", pretty);
-        pthread_mutex_unlock(stdout_guard);
+        // Fails if the worker was stopped while it was busy
+        int expected = WORKER_BUSY;
+        if (!atomic_compare_exchange_strong(&params->state, &expected, WORKER_IDLE))
+        {
+            break;
+        }
+        idle_push(params);
 
-        atomic_store(&params->busy, 0);
+        // The accept thread may have queued a client after last finding the stack empty
+        if (ring_buffer_count(&params->pool->client_backlog) > 0)
+        {
+            pool_wake(params->pool);
+        }
+        has_client = wait_for_client(params, &spin);
     }
 
-    free(params);
+    thread_server_private* pool = params->pool;
+    worker_release(params);
+    pool_release(pool);
     return NULL;
 }
 
+/**
+ * Hands a client to a worker taken off the idle stack. The worker doesn't look at client until it sees
+ * WORKER_BUSY, and while it's on the stack it can only go from idle to parked, or from parked to retired,
+ * so the exchange succeeds on the second try at the latest unless it has retired.
+ *
+ * @return 0 on success, or -1 if the worker has retired.
+ */
+static int worker_assign(worker_params* params, client_t const* client)
+{
+    int state = atomic_load(&params->state);
+    params->client = *client;
+    do
+    {
+        if (state == WORKER_RETIRED)
+        {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&params->state, &state, WORKER_BUSY));
+
+    if (state == WORKER_PARKED)
+    {
+        futex_wake(&params->state, 1);
+    }
+    return 0;
+}
+
+/**
+ * Starts a new worker, adding it to the worker list. The caller checks max_workers.
+ *
+ * @param client The worker's first client, or NULL to start it idle on the stack.
+ * @return 0 on success, or -1 on failure.
+ */
+static int worker_spawn(thread_server_private* private, client_t const* client)
+{
+    worker_params* params = malloc(sizeof(worker_params));
+    if (!params || vector_push_back(&private->worker_params_list, &params) == -1)
+    {
+        perror("malloc");
+        free(params);
+        return -1;
+    }
+
+    atomic_init(&params->state, client ? WORKER_BUSY : WORKER_IDLE);
+    atomic_init(&params->refs, 2);
+    if (client)
+    {
+        params->client = *client;
+    }
+    params->index = private->next_index;
+    params->slot = private->worker_params_list.size - 1;
+    params->pool = private;
+
+    atomic_fetch_add(&private->refs, 1);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker_func, params) != 0)
+    {
+        perror("pthread_create");
+        atomic_fetch_sub(&private->refs, 1);
+        --private->worker_params_list.size;
+        free(params);
+        return -1;
+    }
+    pthread_detach(thread);
+
+    ++private->next_index;
+    ++private->num_workers;
+    atomic_fetch_add(&private->num_kept, 1);
+    if (!client)
+    {
+        idle_push(params);
+    }
+    return 0;
+}
+
+/**
+ * Gives a client to the most recently idled worker, forgetting any retired ones on the way, or to a new
+ * worker if there's room for one.
+ *
+ * @return 0 on success, 1 if every worker is busy and the pool is full, or -1 on failure.
+ */
+static int dispatch(thread_server_private* private, client_t const* client)
+{
+    worker_params* params;
+    while ((params = idle_pop(private)) != NULL)
+    {
+        if (worker_assign(params, client) == 0)
+        {
+            return 0;
+        }
+        worker_forget(private, params);
+    }
+
+    if (private->num_workers >= private->max_workers)
+    {
+        return 1;
+    }
+    return worker_spawn(private, client);
+}
+
+/**
+ * Hands out backlogged clients, oldest first, for as long as there are workers to take them.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+static int dispatch_backlog(thread_server_private* private)
+{
+    while (ring_buffer_count(&private->client_backlog) > 0 &&
+           (atomic_load(&private->idle) != NULL || private->num_workers < private->max_workers))
+    {
+        // Workers take from the backlog too, so it may have emptied since the count
+        client_t client;
+        if (ring_buffer_try_get(&private->client_backlog, &client) == -1)
+        {
+            break;
+        }
+
+        // Only this thread pops the idle stack or changes num_workers, and every worker on the stack having
+        // retired leaves room for a new one, so the pool can't be full
+        int result = dispatch(private, &client);
+        assert(result != 1);
+        if (result != 0)
+        {
+            close(client.sock);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /*********************************************************************************************
 FUNCTION
 
-    Name:		worker_func
+    Name:		accept_loop
 
-    Prototype:	static void* worker_func(void* void_params)
+    Prototype:	static void accept_loop(server_t* server, acceptor_t* acceptor)
 
     Developer:	Shane Spoor/Mat Siwoski
 
     Created On: 2017-02-17
 
     Parameters:
-    void_params - Params from the threaded server
+    server - the thread server
+    acceptor - Struct with acceptor information
 
     Return Values:
 	
     Description:
-    Create the serrver sockets that the will connect to the client and send/receive data.
+    Accepts clients and hands them to the workers until done is set. While the backlog
+    is full nothing more is accepted, and the thread waits for a worker to free up.
 
     Revisions:
-	(none)
+	2026-10-17 - Forget retired workers and move the backlog whenever a worker wakes
+	             the thread.
 
 *********************************************************************************************/
 static void accept_loop(server_t* server, acceptor_t* acceptor)
 {
     thread_server_private* private = (thread_server_private*)server->private;
+    int const fds[2] = { private->wake_fd, acceptor->sock };
+    size_t const backlog_size = private->client_backlog.size;
 
     // Get clients from the acceptor and send them to an available thread
     while (1)
     {
-        client_t next_client;
-        int result = accept_client(acceptor, &next_client);
-        if (result == -1 || atomic_load(&done))
+        reap_retired(private);
+        if (dispatch_backlog(private) == -1)
         {
+            done_set();
             break;
         }
 
-        if (server->add_client(server, next_client) == -1)
+        client_t next_client;
+        size_t num_fds = 2;
+        if (ring_buffer_count(&private->client_backlog) >= backlog_size)
         {
-            break;
+            // Workers empty the backlog themselves, and wake this thread once they see the flag
+            atomic_store(&private->accept_waiting, 1);
+            num_fds = ring_buffer_count(&private->client_backlog) >= backlog_size ? 1 : 2;
         }
+        if (num_fds == 1 || accept_client(acceptor, &next_client) == -1)
+        {
+            if ((num_fds == 2 && errno != EWOULDBLOCK && errno != EAGAIN) || done_wait(fds, num_fds) == -1)
+            {
+                break;
+            }
 
-        ++server->total_served;
-        if (private->worker_params_list.size > server->max_concurrent)
+            uint64_t wakeups;
+            if (read(private->wake_fd, &wakeups, sizeof(wakeups)) == -1 && errno != EAGAIN)
+            {
+                perror("read eventfd");
+            }
+            atomic_store(&private->accept_waiting, 0);
+            continue;
+        }
+
+        if (server->add_client(server, next_client) == -1)
         {
-            server->max_concurrent = private->worker_params_list.size;
+            break;
         }
+
+        // Counts this thread owns, rather than adding up every worker's counters on each accept
+        stats_connection_opened();
+        stats_connections_peak(private->num_workers + ring_buffer_count(&private->client_backlog));
     }
 }
 
@@ -250,84 +695,80 @@ FUNCTION
     Return Values:
 	
     Description:
-    Starts the threaded server. 
+    Starts the threaded server with the minimum number of workers.
 
     Revisions:
-	(none)
+	2026-10-17 - Size the pool from --workers; clean up after a failed start.
 
 *********************************************************************************************/
 int thread_server_start(server_t *thread_server, acceptor_t *acceptor, int *handles_accept)
 {
     *handles_accept = 1;
 
-    thread_server_private* priv = malloc(sizeof(thread_server_private));
+    // The backlog's head and tail are kept on cache lines of their own
+    thread_server_private* priv = aligned_alloc(_Alignof(thread_server_private), sizeof(thread_server_private));
     if (!priv)
     {
-        perror("malloc");
+        perror("aligned_alloc");
         return -1;
     }
 
-    if (pthread_mutex_init(&priv->stdout_guard, NULL) == -1)
+    priv->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (priv->wake_fd == -1)
     {
-        perror("pthread_mutex_init");
+        perror("eventfd");
+        free(priv);
         return -1;
     }
 
-    //ring_buffer_init(&priv->client_backlog, &client_backlog_buf[0], CLIENT_BACKLOG_SIZE, sizeof(client_t));
-
-    if (vector_init(&priv->worker_params_list, sizeof(worker_params*), WORKER_POOL_SIZE) == -1)
+    if (ring_buffer_init(&priv->client_backlog, CLIENT_BACKLOG_SIZE, sizeof(client_t)) == -1)
     {
-        fprintf(stderr, "vector_init failed");
+        perror("ring_buffer_init");
+        close(priv->wake_fd);
+        free(priv);
         return -1;
     }
 
-    size_t i;
-    for(i = 0; i < WORKER_POOL_SIZE; ++i)
+    if (vector_init(&priv->worker_params_list, sizeof(worker_params*), server_options.min_workers) == -1)
     {
-        worker_params* params = malloc(sizeof(worker_params));
-        if (!params)
-        {
-            break;
-        }
-        params->busy = 0;
-        vector_push_back(&priv->worker_params_list, &params);
-    }
-    if (i != WORKER_POOL_SIZE)
-    {
-        size_t const allocd = i;
-        worker_params** worker_param_list = (worker_params**)priv->worker_params_list.items;
-        perror("malloc");
-
-        for (i = 0; i < allocd; ++i)
-        {
-            free(worker_param_list[i]);
-        } 
-        vector_free(&priv->worker_params_list);
+        fprintf(stderr, "vector_init failed");
+        ring_buffer_free(&priv->client_backlog);
+        close(priv->wake_fd);
+        free(priv);
         return -1;
     }
 
-    for (i = 0; i < WORKER_POOL_SIZE; ++i)
+    priv->num_workers = 0;
+    priv->next_index = 0;
+    atomic_init(&priv->idle, NULL);
+    atomic_init(&priv->num_kept, 0);
+    atomic_init(&priv->reap_pending, 0);
+    atomic_init(&priv->accept_waiting, 0);
+    atomic_init(&priv->refs, 1);
+    priv->min_workers = server_options.min_workers;
+    priv->max_workers = server_options.max_workers;
+    priv->idle_ms = server_options.worker_idle * 1000;
+    thread_server->private = priv;
+
+    for (size_t i = 0; i < priv->min_workers; ++i)
     {
-        worker_params** worker_param_list = (worker_params**)priv->worker_params_list.items;
-        pthread_t thread;
-        int result = pthread_create(&thread, NULL, worker_func, worker_param_list[i]);
-        if (result == -1)
+        if (worker_spawn(priv, NULL) == -1)
         {
-            break;
+            thread_server_cleanup(thread_server);
+            return -1;
         }
-        pthread_detach(thread);
-        
     }
 
-    if (i != WORKER_POOL_SIZE)
+    if (placement_enabled())
     {
-        perror("pthread_create");
-        atomic_store(&done, 1);
+        printf("Workers pinned round-robin to the --cpus list, starting with the first\n");
+    }
 
+    if (acceptor_set_nonblocking(acceptor) == -1)
+    {
+        thread_server_cleanup(thread_server);
         return -1;
     }
-
-    thread_server->private = priv;
     accept_loop(thread_server, acceptor);
     return 0;
 }
@@ -350,56 +791,42 @@ FUNCTION
     Return Values:
 	
     Description:
-    Creates and adds the clients.
+    Creates and adds the clients. An idle worker is a single pop off the idle stack; a
+    worker that's still spinning picks the client up by itself, and only a parked one
+    needs waking. Once every worker is busy and the pool is full, the client waits in
+    the backlog, which the caller makes sure has room.
 
     Revisions:
-	(none)
+	2026-10-17 - Wake parked workers with futex_wake.
+	2026-10-17 - Take idle workers off a stack instead of scanning the worker list.
+	2026-10-17 - Queue clients in the backlog once the pool is at its maximum.
 
 *********************************************************************************************/
 static int thread_server_add_client(server_t* server, client_t client)
 {
     thread_server_private* private = (thread_server_private*)server->private;
-    worker_params** list = (worker_params**)private->worker_params_list.items;
 
-    // Find the next non-busy thread, if any
-    unsigned i;
-    for(i = 0; i < private->worker_params_list.size; ++i)
+    // Clients already waiting go first
+    if (ring_buffer_count(&private->client_backlog) == 0)
     {
-        worker_params* params = list[i];
-        int busy = atomic_load(&params->busy);
-        if (!busy)
+        int result = dispatch(private, &client);
+        if (result != 1)
         {
-            list[i]->client = client;
-            atomic_store(&params->busy, 1);
-            break;
+            if (result == -1)
+            {
+                done_set();
+            }
+            return result;
         }
     }
 
-    if (i == private->worker_params_list.size)
+    // The caller made sure there's room; at worst this waits for a worker to finish copying out the oldest
+    ring_buffer_put(&private->client_backlog, &client);
+    if (dispatch_backlog(private) == -1)
     {
-        // All threads are busy; add a new one to the list and give it the new connection
-        worker_params* new_params = NULL;
-        new_params = malloc(sizeof(worker_params));
-        if (!new_params || (vector_push_back(&private->worker_params_list, &new_params) == -1))
-        {
-            atomic_store(&done, 1);
-            free(new_params);
-            return -1;
-        }
-
-        new_params->busy = 1;
-        new_params->client = client;
-
-        pthread_t new_thread;
-        if(pthread_create(&new_thread, NULL, worker_func, new_params) == -1 ||
-           pthread_detach(new_thread) == -1)
-        {
-            atomic_store(&done, 1);
-            free(new_params);
-            return -1;
-        }
+        done_set();
+        return -1;
     }
-
     return 0;
 }
 
@@ -420,19 +847,37 @@ FUNCTION
     Return Values:
 	
     Description:
-    Cleans up and free any sockets/file descriptors the server created.
+    Cleans up and free any sockets/file descriptors the server created. Every worker is
+    told to stop; idle ones exit straight away and busy ones once their client hangs up.
+    Clients still in the backlog are closed.
 
     Revisions:
-	(none)
+	2026-10-17 - Stop the workers through their state, waking the parked ones.
+	2026-10-17 - Close backlogged clients; the pool is freed by the last worker out.
 
 *********************************************************************************************/
 static void thread_server_cleanup(server_t* thread_server)
 {
     thread_server_private* private = (thread_server_private*)thread_server->private;
-    pthread_mutex_destroy(&private->stdout_guard);
-    vector_free(&private->worker_params_list); // The threads will free the individual elements... I hope
-    atomic_store(&done, 1);
-    free(private);
+    worker_params** list = (worker_params**)private->worker_params_list.items;
+    for (size_t i = 0; i < private->worker_params_list.size; ++i)
+    {
+        if (atomic_exchange(&list[i]->state, WORKER_STOPPED) == WORKER_PARKED)
+        {
+            futex_wake(&list[i]->state, 1);
+        }
+        worker_release(list[i]);
+    }
+    vector_free(&private->worker_params_list);
+
+    client_t client;
+    while (ring_buffer_try_get(&private->client_backlog, &client) == 0)
+    {
+        close(client.sock);
+    }
+
+    done_set();
+    pool_release(private);
 }
 
 static server_t thread_server_impl =
@@ -440,8 +885,6 @@ static server_t thread_server_impl =
     thread_server_start,
     thread_server_add_client,
     thread_server_cleanup,
-    0,
-    0,
     NULL
 };
 
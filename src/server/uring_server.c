@@ -0,0 +1,889 @@
+/*********************************************************************************************
+Name:			uring_server.c
+
+    Required:	acceptor.h
+                done.h
+                server.h
+                framing.h
+                transfer_log.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    This is the io_uring server. It accepts clients with a multishot accept, receives into a
+    ring of kernel-provided buffers and echoes each message back with a send SQE, so a whole
+    batch of receives and sends costs a single io_uring_enter call. When a message body is
+    still outstanding after the first receive, the rest of the body and the echo are
+    submitted together as a linked recv/send pair.
+
+    The ring is driven through the raw system calls rather than liburing so that the server
+    has no extra build dependencies.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+#include "transfer_log.h"
+#include "timing.h"
+#include "done.h"
+#include "acceptor.h"
+#include "framing.h"
+#include "options.h"
+#include "server.h"
+#include "stats.h"
+#include "fd_table.h"
+
+#define URING_SQ_ENTRIES  4096
+#define URING_CQ_ENTRIES  (URING_SQ_ENTRIES * 4)
+#define URING_NUM_BUFS    1024   // Must be a power of 2
+#define URING_BUF_SIZE    4096
+#define URING_BUF_GROUP   0
+
+// Operation encoded in the top half of each SQE's user_data; the bottom half is the socket
+enum
+{
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV,        // Receive into a provided buffer
+    URING_OP_RECV_DIRECT, // Receive into the connection's read-ahead buffer when the provided buffers run out
+    URING_OP_RECV_BODY,   // Receive the rest of a message body; linked to the following send
+    URING_OP_SEND,
+    URING_OP_DONE         // Poll on one of done's fds
+};
+
+#define URING_USER_DATA(op, fd) (((uint64_t)(op) << 32) | (uint32_t)(fd))
+#define URING_USER_OP(data)     ((int)((data) >> 32))
+#define URING_USER_FD(data)     ((int)(uint32_t)(data))
+
+static int uring_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int uring_server_add_client(server_t* server, client_t client);
+static void uring_server_cleanup(server_t* server);
+
+static server_t uring_server_impl =
+{
+    uring_server_start,
+    uring_server_add_client,
+    uring_server_cleanup,
+    NULL
+};
+
+server_t* uring_server = &uring_server_impl;
+
+typedef struct
+{
+    client_t client;
+    struct timeval start;
+    framer_t frame;
+    char* recv_dest;      // Where the outstanding direct or body receive is writing
+    stats_timer timer;
+
+    int inflight;         // SQEs submitted for this connection that haven't completed yet
+    int closing;          // 0 while open, 1 once the client finished cleanly, -1 on error
+} uring_server_client;
+
+typedef struct
+{
+    int fd;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    char* bufs;
+    unsigned short buf_tail;
+} uring_ring;
+
+typedef struct
+{
+    uring_ring ring;
+    acceptor_t* acceptor;
+    fd_table_t clients; // uring_server_client*, allocated when the client arrives
+    size_t connected_count;
+} uring_server_private;
+
+/**
+ * Publishes any queued SQEs to the kernel and optionally waits for completions.
+ *
+ * @param ring         The ring.
+ * @param min_complete The number of completions to wait for (0 to just submit).
+ * @return The result of io_uring_enter; -1 with errno set on failure.
+ */
+static int ring_enter(uring_ring* ring, unsigned min_complete)
+{
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    return (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete,
+                        min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/**
+ * Gets the next free SQE, submitting the queued ones first if the submission queue is full.
+ *
+ * @param ring The ring.
+ * @return A zeroed SQE, or NULL if the queue couldn't be drained.
+ */
+static struct io_uring_sqe* ring_get_sqe(uring_ring* ring)
+{
+    if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+    {
+        if (ring_enter(ring, 0) == -1 ||
+            ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    ++ring->sq_local_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/**
+ * Hands a provided buffer back to the kernel.
+ *
+ * @param ring The ring.
+ * @param bid  The buffer ID from the receive's CQE.
+ */
+static void ring_recycle_buf(uring_ring* ring, unsigned short bid)
+{
+    struct io_uring_buf* buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_NUM_BUFS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ++ring->buf_tail;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Closes and unmaps everything ring_init created. The ring goes first, so that the kernel has let go of the
+ * provided buffers and the mapped rings before they're freed.
+ *
+ * @param ring The ring to tear down.
+ */
+static void ring_free(uring_ring* ring)
+{
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->bufs)
+    {
+        free(ring->bufs);
+    }
+    if (ring->buf_ring)
+    {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    if (ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+}
+
+/**
+ * Sets up an io_uring instance and registers the provided buffer ring used for receives.
+ *
+ * @param ring The ring to initialise.
+ * @return 0 on success, or -1 on failure (an error message will have been printed).
+ */
+static int ring_init(uring_ring* ring)
+{
+    memset(ring, 0, sizeof(*ring));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = URING_CQ_ENTRIES;
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+    if (ring->fd == -1 && errno == EINVAL)
+    {
+        // Older kernels don't know the task-running hints
+        params.flags = IORING_SETUP_CQSIZE;
+        ring->fd = (int)syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+    }
+    if (ring->fd == -1)
+    {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+        {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        perror("mmap sq ring");
+        ring_free(ring);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            perror("mmap cq ring");
+            ring_free(ring);
+            return -1;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        perror("mmap sqes");
+        ring_free(ring);
+        return -1;
+    }
+
+    char* sq = (char*)ring->sq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned*)(sq + params.sq_off.ring_entries);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+
+    // SQEs are always used in order, so the indirection array can be filled in once
+    for (unsigned i = 0; i < ring->sq_entries; ++i)
+    {
+        ring->sq_array[i] = i;
+    }
+
+    char* cq = (char*)ring->cq_ring;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Provided buffer ring for receives
+    ring->buf_ring_size = URING_NUM_BUFS * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        perror("mmap buf ring");
+        ring_free(ring);
+        return -1;
+    }
+
+    ring->bufs = malloc((size_t)URING_NUM_BUFS * URING_BUF_SIZE);
+    if (ring->bufs == NULL)
+    {
+        perror("malloc bufs");
+        ring_free(ring);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_NUM_BUFS;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        perror("io_uring_register (provided buffer ring)");
+        ring_free(ring);
+        return -1;
+    }
+
+    for (unsigned short bid = 0; bid < URING_NUM_BUFS; ++bid)
+    {
+        ring_recycle_buf(ring, bid);
+    }
+
+    return 0;
+}
+
+/**
+ * Queues a multishot accept on the listening socket.
+ */
+static int queue_accept(uring_ring* ring, int listen_sock)
+{
+    struct io_uring_sqe* sqe = ring_get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_sock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = URING_USER_DATA(URING_OP_ACCEPT, listen_sock);
+    return 0;
+}
+
+/**
+ * Queues a one-shot poll for one of done's fds becoming readable, so that shutdown completes a wait in
+ * io_uring_enter like any other event.
+ */
+static int queue_done_poll(uring_ring* ring, int fd)
+{
+    struct io_uring_sqe* sqe = ring_get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = URING_USER_DATA(URING_OP_DONE, fd);
+    return 0;
+}
+
+/**
+ * Queues a receive for the next data the framer needs. The kernel picks the buffer from the provided
+ * buffer ring unless they have run out, in which case it receives straight into the framer's buffer.
+ */
+static int queue_recv(uring_ring* ring, uring_server_client* client, int direct)
+{
+    struct io_uring_sqe* sqe = ring_get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->client.sock;
+    if (direct)
+    {
+        size_t len;
+        client->recv_dest = framer_read_dest(&client->frame, &len);
+        sqe->addr = (uint64_t)(uintptr_t)client->recv_dest;
+        sqe->len = (uint32_t)len;
+        sqe->user_data = URING_USER_DATA(URING_OP_RECV_DIRECT, client->client.sock);
+    }
+    else
+    {
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+        sqe->len = URING_BUF_SIZE;
+        sqe->user_data = URING_USER_DATA(URING_OP_RECV, client->client.sock);
+    }
+
+    ++client->inflight;
+    return 0;
+}
+
+/**
+ * Queues a send of the given part of the echo.
+ */
+static int queue_send(uring_ring* ring, uring_server_client* client, char const* buf, uint32_t len)
+{
+    struct io_uring_sqe* sqe = ring_get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = client->client.sock;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->user_data = URING_USER_DATA(URING_OP_SEND, client->client.sock);
+
+    ++client->inflight;
+    return 0;
+}
+
+/**
+ * Queues a receive for the remainder of the current message body, linked to the send that echoes it,
+ * so that both go to the kernel in the same io_uring_enter call.
+ */
+static int queue_recv_body_and_send(uring_ring* ring, uring_server_client* client)
+{
+    struct io_uring_sqe* sqe = ring_get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    size_t len;
+    client->recv_dest = framer_read_dest(&client->frame, &len);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->client.sock;
+    sqe->addr = (uint64_t)(uintptr_t)client->recv_dest;
+    sqe->len = (uint32_t)len;
+    sqe->msg_flags = MSG_WAITALL;
+    sqe->flags = IOSQE_IO_LINK; // A short receive cancels the send
+    sqe->user_data = URING_USER_DATA(URING_OP_RECV_BODY, client->client.sock);
+    ++client->inflight;
+
+    return queue_send(ring, client, client->frame.msg, client->frame.msg_size);
+}
+
+/**
+ * Logs a finished client's stats and frees its record.
+ */
+static void close_client(uring_server_private* priv, uring_server_client* client)
+{
+    --priv->connected_count;
+
+    if (client->closing == 1)
+    {
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        time_t transfer_time = TIME_DIFF(client->start, end);
+
+        transfer_log_append(&end, transfer_time, client->frame.transferred, client->frame.messages,
+                            &client->client.peer);
+        stats_connection_closed(transfer_time);
+
+        if (server_options.verbose)
+        {
+            unsigned short src_port = ntohs(client->client.peer.sin_port);
+            char *addr = inet_ntoa(client->client.peer.sin_addr);
+            printf("Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+                   transfer_time, client->frame.transferred, addr, src_port);
+        }
+    }
+    else
+    {
+        stats_connection_closed(-1);
+    }
+
+    fd_table_set(&priv->clients, client->client.sock, NULL);
+    close(client->client.sock);
+    framer_free(&client->frame);
+    free(client);
+}
+
+/**
+ * Runs the framer over whatever the client has sent and queues whatever the client needs next: the echo,
+ * a receive for more headers, or the rest of a large body along with its echo.
+ *
+ * @return 0 on success, -1 if the ring couldn't take more SQEs.
+ */
+static int advance(uring_ring* ring, uring_server_client* client)
+{
+    framer_t* frame = &client->frame;
+    switch (framer_parse(frame, 0))
+    {
+        case FRAMES_ECHO:
+        {
+            size_t len;
+            char const* out = framer_pending(frame, &len);
+            return queue_send(ring, client, out, (uint32_t)len);
+        }
+        case FRAMES_NEED_DATA:
+            if (frame->state == FRAME_READ_BODY && frame->msg_size - frame->body_have >= FRAME_READ_AHEAD_SIZE)
+            {
+                return queue_recv_body_and_send(ring, client);
+            }
+            return queue_recv(ring, client, 0);
+        case FRAMES_FINISHED:
+            client->closing = 1;
+            return 0;
+        default:
+            client->closing = -1;
+            return 0;
+    }
+}
+
+/**
+ * Handles a single completion.
+ *
+ * @return 0 on success, or -1 on a fatal error.
+ */
+static int handle_cqe(server_t* server, struct io_uring_cqe* cqe)
+{
+    uring_server_private* priv = (uring_server_private*)server->private;
+    uring_ring* ring = &priv->ring;
+    int op = URING_USER_OP(cqe->user_data);
+    int fd = URING_USER_FD(cqe->user_data);
+
+    if (op == URING_OP_ACCEPT)
+    {
+        if (cqe->res >= 0)
+        {
+            client_t client;
+            socklen_t len = sizeof(client.peer);
+            client.sock = cqe->res;
+            getpeername(client.sock, (struct sockaddr*)&client.peer, &len);
+            if (server->add_client(server, client) == -1)
+            {
+                close(client.sock);
+                stats_connection_rejected();
+            }
+        }
+        else if (cqe->res != -EAGAIN && cqe->res != -EINTR)
+        {
+            errno = -cqe->res;
+            perror("accept");
+            return -1;
+        }
+
+        // The kernel stops a multishot accept on errors or overflow; start a new one
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+        {
+            return queue_accept(ring, priv->acceptor->sock);
+        }
+        return 0;
+    }
+    else if (op == URING_OP_DONE)
+    {
+        // Another loop may have taken the signal first, in which case the eventfd wakes this one shortly
+        return done_check() ? 0 : queue_done_poll(ring, fd);
+    }
+
+    uring_server_client* client = fd_table_get(&priv->clients, fd);
+    if (client == NULL)
+    {
+        // Clients are only freed once nothing is in flight, so this shouldn't happen; keep the buffer if it does
+        if (op == URING_OP_RECV && (cqe->flags & IORING_CQE_F_BUFFER))
+        {
+            ring_recycle_buf(ring, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return 0;
+    }
+    framer_t* frame = &client->frame;
+    --client->inflight;
+
+    if (client->closing == 0)
+    {
+        switch (op)
+        {
+            case URING_OP_RECV:
+            case URING_OP_RECV_DIRECT:
+                if (cqe->res == -ENOBUFS)
+                {
+                    // All provided buffers are in use; receive into this client's own buffer instead
+                    if (queue_recv(ring, client, 1) == -1)
+                    {
+                        return -1;
+                    }
+                }
+                else if (cqe->res <= 0)
+                {
+                    if (cqe->res < 0)
+                    {
+                        fprintf(stderr, "uring: recv on socket %d: %s\n", fd, strerror(-cqe->res));
+                    }
+                    client->closing = -1;
+                }
+                else
+                {
+                    if (op == URING_OP_RECV)
+                    {
+                        // A provided buffer never holds more than the framer's read-ahead buffer
+                        unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                        size_t len;
+                        char* dest = framer_read_dest(frame, &len);
+                        memcpy(dest, ring->bufs + (size_t)bid * URING_BUF_SIZE, (size_t)cqe->res);
+                        ring_recycle_buf(ring, bid);
+                        framer_read_done(frame, dest, (size_t)cqe->res);
+                    }
+                    else
+                    {
+                        framer_read_done(frame, client->recv_dest, (size_t)cqe->res);
+                    }
+                    stats_bytes_received((size_t)cqe->res);
+                    stats_message_ready(&client->timer);
+                    if (advance(ring, client) == -1)
+                    {
+                        return -1;
+                    }
+                }
+            break;
+            case URING_OP_RECV_BODY:
+                if (cqe->res < 0 || (uint32_t)cqe->res != frame->msg_size - frame->body_have)
+                {
+                    // The linked send will complete with -ECANCELED
+                    client->closing = -1;
+                }
+                else
+                {
+                    // Completes the body, which moves the framer on to the echo the linked send is already making
+                    framer_read_done(frame, client->recv_dest, (size_t)cqe->res);
+                    stats_bytes_received((size_t)cqe->res);
+                    stats_message_ready(&client->timer);
+                    framer_parse(frame, 0);
+                }
+            break;
+            case URING_OP_SEND:
+                if (cqe->res < 0)
+                {
+                    if (cqe->res != -ECANCELED)
+                    {
+                        fprintf(stderr, "uring: send on socket %d: %s\n", fd, strerror(-cqe->res));
+                    }
+                    client->closing = -1;
+                    break;
+                }
+
+                stats_bytes_sent((size_t)cqe->res);
+                framer_sent(frame, (size_t)cqe->res);
+                if (frame->state == FRAME_WRITE_BODY)
+                {
+                    size_t len;
+                    char const* out = framer_pending(frame, &len);
+                    if (queue_send(ring, client, out, (uint32_t)len) == -1)
+                    {
+                        return -1;
+                    }
+                    break;
+                }
+
+                // Echo done; carry on with whatever else the client has sent
+                stats_messages_echoed(&client->timer, frame->messages);
+                if (advance(ring, client) == -1)
+                {
+                    return -1;
+                }
+            break;
+            default:
+            break;
+        }
+    }
+    else if (op == URING_OP_RECV && (cqe->flags & IORING_CQE_F_BUFFER))
+    {
+        ring_recycle_buf(ring, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+    }
+
+    if (client->closing && client->inflight == 0)
+    {
+        close_client(priv, client);
+    }
+
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		uring_server_start
+
+    Prototype:	static int uring_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1; clients are accepted through the ring.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Sets up the ring and runs the completion loop until done is set.
+
+    Revisions:
+	2026-10-17 - The client table is an fd_table sized by RLIMIT_NOFILE rather than a fixed vector.
+
+*********************************************************************************************/
+static int uring_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    uring_server_private* priv = malloc(sizeof(uring_server_private));
+    if (priv == NULL)
+    {
+        perror("malloc priv");
+        return -1;
+    }
+
+    if (fd_table_init(&priv->clients, fd_table_open_limit()) == -1)
+    {
+        perror("malloc clients");
+        free(priv);
+        return -1;
+    }
+
+    if (ring_init(&priv->ring) == -1)
+    {
+        fd_table_destroy(&priv->clients);
+        free(priv);
+        return -1;
+    }
+
+    priv->acceptor = acceptor;
+    priv->connected_count = 0;
+    server->private = priv;
+
+    uring_ring* ring = &priv->ring;
+    if (queue_accept(ring, acceptor->sock) == -1 || queue_done_poll(ring, done_signal_fd()) == -1 ||
+        queue_done_poll(ring, done_event_fd()) == -1)
+    {
+        return -1;
+    }
+
+    stats_thread_histograms();
+
+    int err = 0;
+    while (!err && !atomic_load(&done))
+    {
+        if (ring_enter(ring, 1) == -1)
+        {
+            if (errno != EINTR)
+            {
+                perror("io_uring_enter");
+                err = 1;
+                break;
+            }
+            continue;
+        }
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail && !err)
+        {
+            struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+            ++head;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+            if (handle_cqe(server, &cqe) == -1)
+            {
+                err = 1;
+            }
+
+            if (head == tail)
+            {
+                tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+    }
+
+    return err ? -1 : 0;
+}
+
+static int uring_server_add_client(server_t* server, client_t client)
+{
+    uring_server_private* priv = (uring_server_private*)server->private;
+    uring_server_client* slot = calloc(1, sizeof(uring_server_client));
+    if (slot == NULL)
+    {
+        perror("malloc client");
+        return -1;
+    }
+    slot->client = client;
+    gettimeofday(&slot->start, NULL);
+
+    if (framer_init(&slot->frame) == -1)
+    {
+        free(slot);
+        return -1;
+    }
+
+    if (fd_table_set(&priv->clients, client.sock, slot) == -1)
+    {
+        fprintf(stderr, "uring: no room in the client table for socket %d\n", client.sock);
+        framer_free(&slot->frame);
+        free(slot);
+        return -1;
+    }
+
+    if (queue_recv(&priv->ring, slot, 0) == -1)
+    {
+        fd_table_set(&priv->clients, client.sock, NULL);
+        framer_free(&slot->frame);
+        free(slot);
+        return -1;
+    }
+
+    stats_connection_opened();
+    stats_connections_peak(++priv->connected_count);
+
+    return 0;
+}
+
+static void uring_server_cleanup(server_t* server)
+{
+    uring_server_private* priv = (uring_server_private*)server->private;
+    if (priv == NULL)
+    {
+        return;
+    }
+
+    // Closing the ring cancels everything still in flight, so the kernel is done with the clients' buffers
+    // before they're freed; the ring's own memory goes last
+    close(priv->ring.fd);
+    priv->ring.fd = -1;
+
+    for (int sock = 0; (size_t)sock < priv->clients.max_fds; ++sock)
+    {
+        uring_server_client* client = fd_table_get(&priv->clients, sock);
+        if (client != NULL)
+        {
+            close(client->client.sock);
+            framer_free(&client->frame);
+            free(client);
+        }
+    }
+
+    fd_table_destroy(&priv->clients);
+    ring_free(&priv->ring);
+    free(priv);
+    server->private = NULL;
+}
@@ -0,0 +1,92 @@
+/*********************************************************************************************
+Name:			histogram_merge.c
+
+    Required:	histogram.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Combines histograms saved by several clients (or servers) into one and prints its
+    percentiles, e.g. to get the round trip times of a test run spread over many client
+    processes or machines.
+
+    Usage: histogram-merge [-o merged.hist] file...
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "histogram.h"
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		main
+
+    Prototype:	int main(int argc, char** argv)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    argc - the number of arguments.
+    argv - the program name, optionally -o and the file to save the merged histogram in,
+           then the histograms to merge.
+
+    Return Values:
+    EXIT_SUCCESS, or EXIT_FAILURE if any file couldn't be read or written.
+
+    Description:
+    Reads every file into the same histogram, prints the result and saves it if asked to.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int main(int argc, char** argv)
+{
+    char const* out_name = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "o:h")) != -1)
+    {
+        switch (c)
+        {
+            case 'o':
+                out_name = optarg;
+            break;
+            default:
+                fprintf(stderr, "usage: %s [-o merged.hist] file...\n", argv[0]);
+                return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc)
+    {
+        fprintf(stderr, "usage: %s [-o merged.hist] file...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static histogram_t merged;
+    for (int i = optind; i < argc; ++i)
+    {
+        if (histogram_read(&merged, argv[i]) == -1)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    histogram_print(&merged, stdout, "Merged", "");
+    if (out_name != NULL && histogram_write(&merged, out_name) == -1)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
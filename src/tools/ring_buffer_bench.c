@@ -0,0 +1,256 @@
+/*********************************************************************************************
+Name:			ring_buffer_bench.c
+
+    Required:	ring_buffer.h
+                futex.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Measures the ring buffer's throughput with a number of producer and consumer threads,
+    first with the try_ calls retrying on a full or empty queue and then with the blocking
+    calls, and checks that every item put was got exactly once.
+
+    Usage: ring-buffer-bench [-p producers] [-c consumers] [-n items] [-s size]
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE // getopt under -std=c11
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "futex.h"
+#include "ring_buffer.h"
+
+typedef struct
+{
+    ring_buffer_t* buf;
+    uint64_t first;     // A producer puts first + 1 ... first + count; a consumer gets count items
+    uint64_t count;
+    int blocking;
+    uint64_t sum;       // Of the items a consumer got
+} bench_thread;
+
+// Failed tries before a spinning thread yields, so that it doesn't hold the CPU its peer needs when there are
+// more threads than CPUs
+#define SPIN_BEFORE_YIELD 64
+
+/**
+ * Waits a little before the next try.
+ */
+static void backoff(unsigned int* tries)
+{
+    if (++*tries % SPIN_BEFORE_YIELD == 0)
+    {
+        sched_yield();
+    }
+    else
+    {
+        futex_cpu_relax();
+    }
+}
+
+/**
+ * Puts this producer's share of the items.
+ */
+static void* produce(void* void_thread)
+{
+    bench_thread* thread = (bench_thread*)void_thread;
+    unsigned int tries = 0;
+    for (uint64_t i = 1; i <= thread->count; ++i)
+    {
+        uint64_t item = thread->first + i;
+        if (thread->blocking)
+        {
+            ring_buffer_put(thread->buf, &item);
+        }
+        else
+        {
+            while (ring_buffer_try_put(thread->buf, &item) == -1)
+            {
+                backoff(&tries);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Gets this consumer's share of the items, summing them.
+ */
+static void* consume(void* void_thread)
+{
+    bench_thread* thread = (bench_thread*)void_thread;
+    unsigned int tries = 0;
+    for (uint64_t i = 0; i < thread->count; ++i)
+    {
+        uint64_t item;
+        if (thread->blocking)
+        {
+            ring_buffer_get(thread->buf, &item);
+        }
+        else
+        {
+            while (ring_buffer_try_get(thread->buf, &item) == -1)
+            {
+                backoff(&tries);
+            }
+        }
+        thread->sum += item;
+    }
+    return NULL;
+}
+
+/**
+ * Runs one round and prints its throughput.
+ *
+ * @return 0 if every item was got exactly once, or -1 otherwise.
+ */
+static int run(ring_buffer_t* buf, unsigned int producers, unsigned int consumers, uint64_t items, int blocking)
+{
+    bench_thread threads[producers + consumers];
+    pthread_t ids[producers + consumers];
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    unsigned int started = 0;
+    for (unsigned int i = 0; i < producers + consumers; ++i)
+    {
+        int producer = i < producers;
+        unsigned int index = producer ? i : i - producers;
+        unsigned int num = producer ? producers : consumers;
+        bench_thread* thread = &threads[i];
+        thread->buf = buf;
+        thread->first = producer ? items / num * index : 0;
+        thread->count = items / num + (index == num - 1 ? items % num : 0);
+        thread->blocking = blocking;
+        thread->sum = 0;
+        if (pthread_create(&ids[i], NULL, producer ? produce : consume, thread) != 0)
+        {
+            perror("pthread_create");
+            break;
+        }
+        ++started;
+    }
+    for (unsigned int i = 0; i < started; ++i)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    if (started != producers + consumers)
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+    uint64_t sum = 0;
+    for (unsigned int i = producers; i < producers + consumers; ++i)
+    {
+        sum += threads[i].sum;
+    }
+
+    printf("%-9s %u producers, %u consumers: %llu items in %.3fs, %.0f items/s\n",
+           blocking ? "blocking" : "spinning", producers, consumers, (unsigned long long)items, secs,
+           (double)items / secs);
+
+    // The items are 1 ... items between them
+    if (sum != items * (items + 1) / 2 || ring_buffer_count(buf) != 0)
+    {
+        fprintf(stderr, "Items were lost or duplicated\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		main
+
+    Prototype:	int main(int argc, char** argv)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    argc - the number of arguments.
+    argv - the arguments.
+
+    Return Values:
+    EXIT_SUCCESS if both rounds passed their check, or EXIT_FAILURE.
+
+    Description:
+    Runs a spinning round and then a blocking round on the same queue.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int main(int argc, char** argv)
+{
+    unsigned int producers = 2;
+    unsigned int consumers = 2;
+    unsigned long long items = 10000000;
+    unsigned int size = 1024;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:n:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                producers = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+            case 'c':
+                consumers = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+            case 'n':
+                items = strtoull(optarg, NULL, 10);
+            break;
+            case 's':
+                size = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+            default:
+                fprintf(stderr, "Usage: %s [-p producers] [-c consumers] [-n items] [-s size]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (producers == 0 || consumers == 0 || items == 0 || size == 0)
+    {
+        fprintf(stderr, "Producers, consumers, items and size must all be at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    ring_buffer_t* buf = aligned_alloc(_Alignof(ring_buffer_t), sizeof(ring_buffer_t));
+    if (!buf || ring_buffer_init(buf, size, sizeof(uint64_t)) == -1)
+    {
+        perror("ring_buffer_init");
+        free(buf);
+        return EXIT_FAILURE;
+    }
+
+    int result = 0;
+    if (run(buf, producers, consumers, items, 0) == -1 || run(buf, producers, consumers, items, 1) == -1)
+    {
+        result = -1;
+    }
+
+    ring_buffer_free(buf);
+    free(buf);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+/*********************************************************************************************
+Name:			transfers_dump.c
+
+    Required:	transfer_log.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Converts the server's binary transfer log into the transfer_time,transferred,addr:port
+    CSV that the server used to write itself, one line per finished connection.
+
+    Usage: transfers-dump [log file] > transfers.txt
+    The log file defaults to transfers.bin.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transfer_log.h"
+
+#define RECORDS_PER_READ 4096
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		main
+
+    Prototype:	int main(int argc, char** argv)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    argc - the number of arguments.
+    argv - the program name and, optionally, the log file to read.
+
+    Return Values:
+    EXIT_SUCCESS, or EXIT_FAILURE if the file couldn't be read or isn't a transfer log.
+
+    Description:
+    Checks the log's header, then prints a CSV line for each valid record. Empty slots left
+    by a server that didn't shut down cleanly are skipped.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int main(int argc, char** argv)
+{
+    char const* name = argc > 1 ? argv[1] : "transfers.bin";
+    FILE* in = fopen(name, "rb");
+    if (in == NULL)
+    {
+        perror(name);
+        return EXIT_FAILURE;
+    }
+
+    transfer_log_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, TRANSFER_LOG_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "%s: not a transfer log\n", name);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+    if (header.version != TRANSFER_LOG_VERSION || header.record_size != sizeof(transfer_record))
+    {
+        fprintf(stderr, "%s: unsupported version %u (record size %u)\n", name, header.version, header.record_size);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    static transfer_record records[RECORDS_PER_READ];
+    size_t num_read;
+    while ((num_read = fread(records, sizeof(transfer_record), RECORDS_PER_READ, in)) > 0)
+    {
+        for (size_t i = 0; i < num_read; ++i)
+        {
+            transfer_record const* record = &records[i];
+            if (!(record->flags & TRANSFER_RECORD_VALID))
+            {
+                continue;
+            }
+
+            char addr[INET_ADDRSTRLEN];
+            struct in_addr in_addr = { record->addr };
+            inet_ntop(AF_INET, &in_addr, addr, sizeof(addr));
+            printf("%lld,%lld,%s:%hu\n", (long long)record->transfer_time, (long long)record->transferred, addr,
+                   record->port);
+        }
+    }
+
+    int result = EXIT_SUCCESS;
+    if (ferror(in))
+    {
+        perror(name);
+        result = EXIT_FAILURE;
+    }
+    fclose(in);
+    return result;
+}
@@ -0,0 +1,403 @@
+/*********************************************************************************************
+Name:			buffer_pool.c
+
+    Required:	buffer_pool.h
+
+    Developer:  Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Size-class pool for the servers' message buffers. Each thread keeps a free list per size
+    class so that allocating and freeing a buffer is normally just a list push or pop; the
+    global depot behind the caches only sees batches of buffers moving between threads.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "buffer_pool.h"
+
+#define MIN_CLASS_SHIFT 8  // log2(BUFFER_POOL_MIN_SIZE)
+#define NUM_CLASSES     13 // 256 B up to 1 MB
+#define LARGE_CLASS     NUM_CLASSES
+
+#define CACHE_BYTES_PER_CLASS (1024 * 1024)      // Per thread
+#define DEPOT_BYTES_PER_CLASS (16 * 1024 * 1024)
+
+/**
+ * Precedes every buffer. Kept at 16 bytes so that the buffer itself stays suitably aligned for anything.
+ */
+typedef struct
+{
+    size_t cls;
+    size_t cap;
+} buffer_header;
+
+/**
+ * Free buffers are linked through their own memory.
+ */
+typedef struct free_buffer
+{
+    struct free_buffer* next;
+} free_buffer;
+
+typedef struct
+{
+    free_buffer* head[NUM_CLASSES];
+    size_t count[NUM_CLASSES];
+} thread_cache;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    free_buffer* head;
+    size_t count;
+} depot_class;
+
+static depot_class depot[NUM_CLASSES];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+
+static _Thread_local thread_cache cache;
+static _Thread_local int cache_registered;
+
+static void cache_release(void* void_cache);
+
+/**
+ * Sets up the depot locks and the key used to flush a thread's cache when it exits.
+ */
+static void pool_init(void)
+{
+    for (size_t i = 0; i < NUM_CLASSES; ++i)
+    {
+        pthread_mutex_init(&depot[i].lock, NULL);
+    }
+    pthread_key_create(&cache_key, cache_release);
+}
+
+/**
+ * Returns the calling thread's cache, registering it to be flushed to the depot when the thread exits.
+ *
+ * @return The thread's cache.
+ */
+static thread_cache* get_cache(void)
+{
+    if (!cache_registered)
+    {
+        pthread_once(&pool_once, pool_init);
+        pthread_setspecific(cache_key, &cache);
+        cache_registered = 1;
+    }
+    return &cache;
+}
+
+static size_t class_size(size_t cls)
+{
+    return (size_t)1 << (cls + MIN_CLASS_SHIFT);
+}
+
+static size_t class_of(size_t size)
+{
+    if (size <= BUFFER_POOL_MIN_SIZE)
+    {
+        return 0;
+    }
+    return (size_t)(sizeof(unsigned long) * 8 - __builtin_clzl(size - 1)) - MIN_CLASS_SHIFT;
+}
+
+static size_t cache_limit(size_t cls)
+{
+    size_t limit = CACHE_BYTES_PER_CLASS / class_size(cls);
+    return limit < 4 ? 4 : limit;
+}
+
+static size_t depot_limit(size_t cls)
+{
+    size_t limit = DEPOT_BYTES_PER_CLASS / class_size(cls);
+    return limit < 64 ? 64 : limit;
+}
+
+/**
+ * Frees a NULL-terminated chain of buffers back to the system.
+ */
+static void free_chain(free_buffer* chain)
+{
+    while (chain != NULL)
+    {
+        free_buffer* next = chain->next;
+        free((buffer_header*)chain - 1);
+        chain = next;
+    }
+}
+
+/**
+ * Hands a NULL-terminated chain of count buffers of the given class to the depot, or back to the system
+ * if the depot is already holding as many as it's allowed to.
+ */
+static void depot_put(size_t cls, free_buffer* chain, free_buffer* tail, size_t count)
+{
+    depot_class* d = &depot[cls];
+    pthread_mutex_lock(&d->lock);
+    if (d->count + count <= depot_limit(cls))
+    {
+        tail->next = d->head;
+        d->head = chain;
+        d->count += count;
+        chain = NULL;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    free_chain(chain);
+}
+
+/**
+ * Moves up to half a cache's worth of buffers of the given class from the depot into the thread's cache.
+ */
+static void depot_get(thread_cache* c, size_t cls)
+{
+    depot_class* d = &depot[cls];
+    size_t want = cache_limit(cls) / 2;
+
+    pthread_mutex_lock(&d->lock);
+    free_buffer* chain = d->head;
+    free_buffer* tail = NULL;
+    size_t taken = 0;
+    for (free_buffer* b = chain; b != NULL && taken < want; b = b->next)
+    {
+        tail = b;
+        ++taken;
+    }
+    if (tail != NULL)
+    {
+        d->head = tail->next;
+        d->count -= taken;
+        tail->next = c->head[cls];
+        c->head[cls] = chain;
+        c->count[cls] += taken;
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+/**
+ * Flushes an exiting thread's cache into the depot.
+ *
+ * @param void_cache The thread's cache.
+ */
+static void cache_release(void* void_cache)
+{
+    thread_cache* c = (thread_cache*)void_cache;
+    for (size_t cls = 0; cls < NUM_CLASSES; ++cls)
+    {
+        if (c->head[cls] != NULL)
+        {
+            free_buffer* tail = c->head[cls];
+            while (tail->next != NULL)
+            {
+                tail = tail->next;
+            }
+            depot_put(cls, c->head[cls], tail, c->count[cls]);
+            c->head[cls] = NULL;
+            c->count[cls] = 0;
+        }
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		buffer_pool_alloc
+
+    Prototype:	void* buffer_pool_alloc(size_t size)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    size - the number of usable bytes required.
+
+    Return Values:
+    The buffer, or NULL if out of memory.
+
+    Description:
+    Takes a buffer of the matching size class from the thread's cache, refilling the cache
+    from the depot if it's empty, and only falls back to malloc if both are empty.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void* buffer_pool_alloc(size_t size)
+{
+    buffer_header* header;
+    if (size > BUFFER_POOL_MAX_SIZE)
+    {
+        header = malloc(sizeof(buffer_header) + size);
+        if (header == NULL)
+        {
+            return NULL;
+        }
+        header->cls = LARGE_CLASS;
+        header->cap = size;
+        return header + 1;
+    }
+
+    size_t cls = class_of(size);
+    thread_cache* c = get_cache();
+    if (c->head[cls] == NULL)
+    {
+        depot_get(c, cls);
+    }
+
+    free_buffer* buf = c->head[cls];
+    if (buf != NULL)
+    {
+        c->head[cls] = buf->next;
+        --c->count[cls];
+        return buf;
+    }
+
+    header = malloc(sizeof(buffer_header) + class_size(cls));
+    if (header == NULL)
+    {
+        return NULL;
+    }
+    header->cls = cls;
+    header->cap = class_size(cls);
+    return header + 1;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		buffer_pool_reserve
+
+    Prototype:	void* buffer_pool_reserve(void* buf, size_t size)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    buf - the current buffer, or NULL.
+    size - the number of usable bytes required.
+
+    Return Values:
+    A buffer of at least size bytes, or NULL if out of memory.
+
+    Description:
+    Returns buf if it is already big enough; otherwise allocates a buffer of the right class
+    and frees buf. The contents are not copied.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void* buffer_pool_reserve(void* buf, size_t size)
+{
+    if (buf != NULL && buffer_pool_capacity(buf) >= size)
+    {
+        return buf;
+    }
+
+    void* bigger = buffer_pool_alloc(size);
+    if (bigger != NULL)
+    {
+        buffer_pool_free(buf);
+    }
+    return bigger;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		buffer_pool_capacity
+
+    Prototype:	size_t buffer_pool_capacity(void const* buf)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    buf - a buffer from the pool.
+
+    Return Values:
+    The number of usable bytes in the buffer.
+
+    Description:
+    Reads the buffer's capacity from its header.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+size_t buffer_pool_capacity(void const* buf)
+{
+    return ((buffer_header const*)buf - 1)->cap;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		buffer_pool_free
+
+    Prototype:	void buffer_pool_free(void* buf)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    buf - a buffer from the pool, or NULL.
+
+    Return Values:
+
+    Description:
+    Puts the buffer in the calling thread's cache. If that takes the cache over its limit for
+    the class, half of the cached buffers are moved to the depot in one go.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void buffer_pool_free(void* buf)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    buffer_header* header = (buffer_header*)buf - 1;
+    if (header->cls == LARGE_CLASS)
+    {
+        free(header);
+        return;
+    }
+
+    size_t cls = header->cls;
+    thread_cache* c = get_cache();
+    free_buffer* node = (free_buffer*)buf;
+    node->next = c->head[cls];
+    c->head[cls] = node;
+
+    if (++c->count[cls] > cache_limit(cls))
+    {
+        size_t spill = c->count[cls] / 2;
+        free_buffer* chain = c->head[cls];
+        free_buffer* tail = chain;
+        for (size_t i = 1; i < spill; ++i)
+        {
+            tail = tail->next;
+        }
+        c->head[cls] = tail->next;
+        c->count[cls] -= spill;
+        tail->next = NULL;
+        depot_put(cls, chain, tail, spill);
+    }
+}
@@ -0,0 +1,286 @@
+/*********************************************************************************************
+Name:			counters.c
+
+    Required:	counters.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Per-thread counter blocks. A thread finds its block for a group in a small thread-local
+    table; blocks are never freed, only handed on to another thread when their owner exits,
+    which is what lets readers walk the list without any locking.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "counters.h"
+
+struct counter_block
+{
+    _Alignas(COUNTERS_CACHE_LINE) atomic_uint_fast64_t values[COUNTERS_MAX]; // Only written by the owner
+    _Alignas(COUNTERS_CACHE_LINE) atomic_int owned;
+    counter_block* next;
+};
+
+typedef struct
+{
+    counters_t* counters;
+    counter_block* block; // NULL if the thread couldn't get one, in which case it uses the shared counters
+} thread_entry;
+
+static pthread_once_t counters_once = PTHREAD_ONCE_INIT;
+static pthread_key_t release_key;
+
+static _Thread_local thread_entry thread_blocks[COUNTERS_MAX_GROUPS];
+static _Thread_local size_t thread_num_blocks;
+
+/**
+ * Gives an exiting thread's blocks up so that other threads can take them over.
+ *
+ * @param void_entries The thread's table of blocks.
+ */
+static void release_blocks(void* void_entries)
+{
+    thread_entry* entries = (thread_entry*)void_entries;
+    for (size_t i = 0; i < COUNTERS_MAX_GROUPS; ++i)
+    {
+        if (entries[i].block != NULL)
+        {
+            atomic_store_explicit(&entries[i].block->owned, 0, memory_order_release);
+        }
+    }
+}
+
+static void counters_init(void)
+{
+    pthread_key_create(&release_key, release_blocks);
+}
+
+/**
+ * Takes over a block given up by an exited thread, or allocates a new one.
+ *
+ * @return The block, or NULL if out of memory.
+ */
+static counter_block* claim_block(counters_t* counters)
+{
+    counter_block* block;
+    for (block = atomic_load(&counters->blocks); block != NULL; block = block->next)
+    {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&block->owned, &expected, 1))
+        {
+            return block;
+        }
+    }
+
+    block = aligned_alloc(COUNTERS_CACHE_LINE, sizeof(counter_block));
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < COUNTERS_MAX; ++i)
+    {
+        atomic_init(&block->values[i], 0);
+    }
+    atomic_init(&block->owned, 1);
+
+    block->next = atomic_load(&counters->blocks);
+    while (!atomic_compare_exchange_weak(&counters->blocks, &block->next, block));
+    return block;
+}
+
+/**
+ * Returns the calling thread's block for the group, claiming one the first time the thread counts in it.
+ *
+ * @return The block, or NULL if the thread has to use the shared counters.
+ */
+static counter_block* get_block(counters_t* counters)
+{
+    for (size_t i = 0; i < thread_num_blocks; ++i)
+    {
+        if (thread_blocks[i].counters == counters)
+        {
+            return thread_blocks[i].block;
+        }
+    }
+
+    if (thread_num_blocks == COUNTERS_MAX_GROUPS)
+    {
+        return NULL;
+    }
+
+    if (thread_num_blocks == 0)
+    {
+        pthread_once(&counters_once, counters_init);
+        pthread_setspecific(release_key, thread_blocks);
+    }
+
+    thread_entry* entry = &thread_blocks[thread_num_blocks++];
+    entry->counters = counters;
+    entry->block = claim_block(counters);
+    return entry->block;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		counters_add
+
+    Prototype:	void counters_add(counters_t* counters, size_t counter, uint64_t value)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    counters - the group.
+    counter - the counter's index.
+    value - the amount to add.
+
+    Return Values:
+
+    Description:
+    Only the owning thread stores to its block, so a load and a release store are enough;
+    on x86 that's two plain movs. The release store is what lets a reader that sees this
+    count also see whatever the thread counted before it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void counters_add(counters_t* counters, size_t counter, uint64_t value)
+{
+    counter_block* block = get_block(counters);
+    if (block == NULL)
+    {
+        atomic_fetch_add(&counters->shared[counter], value);
+        return;
+    }
+
+    atomic_uint_fast64_t* slot = &block->values[counter];
+    atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + value, memory_order_release);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		counters_raise
+
+    Prototype:	void counters_raise(counters_t* counters, size_t counter, uint64_t value)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    counters - the group.
+    counter - the counter's index.
+    value - the new value.
+
+    Return Values:
+
+    Description:
+    Stores the value if it's higher than the thread's current one.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void counters_raise(counters_t* counters, size_t counter, uint64_t value)
+{
+    counter_block* block = get_block(counters);
+    if (block == NULL)
+    {
+        uint_fast64_t current = atomic_load(&counters->shared[counter]);
+        while (value > current && !atomic_compare_exchange_weak(&counters->shared[counter], &current, value));
+        return;
+    }
+
+    atomic_uint_fast64_t* slot = &block->values[counter];
+    if (value > atomic_load_explicit(slot, memory_order_relaxed))
+    {
+        atomic_store_explicit(slot, value, memory_order_release);
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		counters_sum
+
+    Prototype:	uint64_t counters_sum(counters_t* counters, size_t counter)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    counters - the group.
+    counter - the counter's index.
+
+    Return Values:
+    The total across every thread.
+
+    Description:
+    Walks every block, so it costs a cache miss or so per thread that has ever counted;
+    meant for reporters and the like rather than the request path.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t counters_sum(counters_t* counters, size_t counter)
+{
+    uint64_t total = atomic_load(&counters->shared[counter]);
+    for (counter_block* block = atomic_load(&counters->blocks); block != NULL; block = block->next)
+    {
+        total += atomic_load_explicit(&block->values[counter], memory_order_acquire);
+    }
+    return total;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		counters_max
+
+    Prototype:	uint64_t counters_max(counters_t* counters, size_t counter)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    counters - the group.
+    counter - the counter's index.
+
+    Return Values:
+    The largest value of the counter in any thread.
+
+    Description:
+    As counters_sum, but for counters kept with counters_raise.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t counters_max(counters_t* counters, size_t counter)
+{
+    uint64_t max = atomic_load(&counters->shared[counter]);
+    for (counter_block* block = atomic_load(&counters->blocks); block != NULL; block = block->next)
+    {
+        uint64_t value = atomic_load_explicit(&block->values[counter], memory_order_acquire);
+        if (value > max)
+        {
+            max = value;
+        }
+    }
+    return max;
+}
@@ -0,0 +1,237 @@
+/*********************************************************************************************
+Name:			fd_table.c
+
+    Required:	fd_table.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Two-level table of pointers indexed by file descriptor. Pages are published with a
+    release store after they're zeroed, so a reader that sees a page sees it empty or
+    with entries stored since.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "fd_table.h"
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		fd_table_init
+
+    Prototype:	int fd_table_init(fd_table_t* table, size_t max_fds)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    table - the table.
+    max_fds - one more than the largest fd to be stored.
+
+    Return Values:
+    0 on success, or -1 if out of memory.
+
+    Description:
+    Allocates the directory; at the default fd limit of 131072 that's 32 pointers.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int fd_table_init(fd_table_t* table, size_t max_fds)
+{
+    table->max_fds = max_fds;
+    table->num_pages = (max_fds + FD_TABLE_PAGE_SIZE - 1) / FD_TABLE_PAGE_SIZE;
+    table->pages = malloc(table->num_pages * sizeof(*table->pages));
+    if (table->pages == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < table->num_pages; ++i)
+    {
+        atomic_init(&table->pages[i], NULL);
+    }
+
+    pthread_mutex_init(&table->lock, NULL);
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		fd_table_open_limit
+
+    Prototype:	size_t fd_table_open_limit(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    The number of fds the process can open, at most FD_TABLE_MAX_FDS.
+
+    Description:
+    Reads the soft limit, which is what open and accept are held to.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+size_t fd_table_open_limit(void)
+{
+    struct rlimit open_file_limit;
+    size_t max_fds = FD_TABLE_MAX_FDS;
+    if (getrlimit(RLIMIT_NOFILE, &open_file_limit) == 0 && open_file_limit.rlim_cur < max_fds)
+    {
+        max_fds = open_file_limit.rlim_cur;
+    }
+    return max_fds;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		fd_table_get
+
+    Prototype:	void* fd_table_get(fd_table_t* table, int fd)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    table - the table.
+    fd - the fd.
+
+    Return Values:
+    The fd's entry, or NULL.
+
+    Description:
+    An acquire load of the page, then a plain load of the entry.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void* fd_table_get(fd_table_t* table, int fd)
+{
+    if (fd < 0 || (size_t)fd >= table->max_fds)
+    {
+        return NULL;
+    }
+
+    void** page = atomic_load_explicit(&table->pages[fd >> FD_TABLE_PAGE_BITS], memory_order_acquire);
+    if (page == NULL)
+    {
+        return NULL;
+    }
+    return page[fd & (FD_TABLE_PAGE_SIZE - 1)];
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		fd_table_set
+
+    Prototype:	int fd_table_set(fd_table_t* table, int fd, void* value)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    table - the table.
+    fd - the fd.
+    value - the entry, or NULL.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Clearing an entry on a page that doesn't exist yet is a no-op rather than a reason to
+    allocate one.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int fd_table_set(fd_table_t* table, int fd, void* value)
+{
+    if (fd < 0 || (size_t)fd >= table->max_fds)
+    {
+        return -1;
+    }
+
+    _Atomic(void**)* slot = &table->pages[fd >> FD_TABLE_PAGE_BITS];
+    void** page = atomic_load_explicit(slot, memory_order_acquire);
+    if (page == NULL)
+    {
+        if (value == NULL)
+        {
+            return 0;
+        }
+
+        pthread_mutex_lock(&table->lock);
+        page = atomic_load_explicit(slot, memory_order_relaxed);
+        if (page == NULL)
+        {
+            page = calloc(FD_TABLE_PAGE_SIZE, sizeof(void*));
+            if (page == NULL)
+            {
+                pthread_mutex_unlock(&table->lock);
+                return -1;
+            }
+            atomic_store_explicit(slot, page, memory_order_release);
+        }
+        pthread_mutex_unlock(&table->lock);
+    }
+
+    page[fd & (FD_TABLE_PAGE_SIZE - 1)] = value;
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		fd_table_destroy
+
+    Prototype:	void fd_table_destroy(fd_table_t* table)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    table - the table.
+
+    Return Values:
+
+    Description:
+    Frees every page that was allocated, then the directory.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void fd_table_destroy(fd_table_t* table)
+{
+    for (size_t i = 0; i < table->num_pages; ++i)
+    {
+        free(atomic_load(&table->pages[i]));
+    }
+    free(table->pages);
+    table->pages = NULL;
+    table->num_pages = 0;
+    pthread_mutex_destroy(&table->lock);
+}
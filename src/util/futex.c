@@ -0,0 +1,139 @@
+/*********************************************************************************************
+Name:			futex.c
+
+    Required:	futex.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    The futex system call, which glibc doesn't wrap.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE // syscall
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "futex.h"
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		futex_wait
+
+    Prototype:	void futex_wait(atomic_int* word, int expected)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    word - the word to wait on.
+    expected - the value that means "keep waiting".
+
+    Return Values:
+
+    Description:
+    The kernel compares the word with expected under its own lock, so a wake between the
+    caller's last check and going to sleep isn't lost: the wait returns straight away.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void futex_wait(atomic_int* word, int expected)
+{
+    if (syscall(SYS_futex, (int*)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0) == -1 &&
+        errno != EAGAIN && errno != EINTR)
+    {
+        perror("futex wait");
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		futex_wait_for
+
+    Prototype:	int futex_wait_for(atomic_int* word, int expected, unsigned int timeout_ms)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    word - the word to wait on.
+    expected - the value that means "keep waiting".
+    timeout_ms - the longest to sleep.
+
+    Return Values:
+    0 if woken, interrupted or the word had already changed, or -1 on timeout.
+
+    Description:
+    FUTEX_WAIT takes a relative timeout, so an early return followed by another wait
+    starts the timeout again.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int futex_wait_for(atomic_int* word, int expected, unsigned int timeout_ms)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    if (syscall(SYS_futex, (int*)word, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0) == -1)
+    {
+        if (errno == ETIMEDOUT)
+        {
+            return -1;
+        }
+        if (errno != EAGAIN && errno != EINTR)
+        {
+            perror("futex wait");
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		futex_wake
+
+    Prototype:	void futex_wake(atomic_int* word, int count)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    word - the word being waited on.
+    count - the most waiters to wake.
+
+    Return Values:
+
+    Description:
+    Callers only make this call when they know a thread is, or is about to be, asleep.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void futex_wake(atomic_int* word, int count)
+{
+    if (syscall(SYS_futex, (int*)word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0) == -1)
+    {
+        perror("futex wake");
+    }
+}
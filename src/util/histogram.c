@@ -0,0 +1,624 @@
+/*********************************************************************************************
+Name:			histogram.c
+
+    Required:	histogram.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Log-linear histogram used for the server's and client's latency stats. A value's bucket
+    comes straight from the position of its highest set bit and the HISTOGRAM_SUB_BUCKET_BITS
+    bits below it, so recording never searches or allocates. Histograms are saved as text so
+    that the ones from several client processes can be merged afterwards.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+/**
+ * Gets the bucket that counts the given value.
+ */
+static size_t bucket_index(uint64_t value)
+{
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+
+    // Keep the top HISTOGRAM_SUB_BUCKET_BITS + 1 bits; the shift picks the power of two
+    unsigned int shift = 63 - (unsigned int)__builtin_clzll(value) - HISTOGRAM_SUB_BUCKET_BITS;
+    return (size_t)shift * HISTOGRAM_SUB_BUCKETS + (size_t)(value >> shift);
+}
+
+/**
+ * Gets the smallest value counted by the given bucket.
+ */
+static uint64_t bucket_low(size_t index)
+{
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    unsigned int shift = (unsigned int)(index / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return sub << shift;
+}
+
+/**
+ * Raises the recorded maximum to the given value if it's larger.
+ */
+static void raise_max(histogram_t* histogram, uint64_t value)
+{
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value,
+                                                                 memory_order_relaxed, memory_order_relaxed));
+}
+
+/**
+ * Gets the largest value counted by the given bucket.
+ */
+static uint64_t bucket_high(size_t index)
+{
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    unsigned int shift = (unsigned int)(index / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_record
+
+    Prototype:	void histogram_record(histogram_t* histogram, uint64_t value)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+    value - the value to record.
+
+    Return Values:
+
+    Description:
+    Counts the value in its bucket.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void histogram_record(histogram_t* histogram, uint64_t value)
+{
+    histogram_record_n(histogram, value, 1);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_record_n
+
+    Prototype:	void histogram_record_n(histogram_t* histogram, uint64_t value, uint64_t count)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+    value - the value to record.
+    count - the number of times to record it.
+
+    Return Values:
+
+    Description:
+    Adds count to the value's bucket and raises the maximum if needed.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void histogram_record_n(histogram_t* histogram, uint64_t value, uint64_t count)
+{
+    atomic_fetch_add_explicit(&histogram->counts[bucket_index(value)], count, memory_order_relaxed);
+    raise_max(histogram, value);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_add
+
+    Prototype:	void histogram_add(histogram_t* histogram, histogram_t const* other)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram to add to.
+    other - the histogram to add.
+
+    Return Values:
+
+    Description:
+    Adds the other histogram's buckets to this one's. Both use the same buckets, so nothing
+    is lost.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void histogram_add(histogram_t* histogram, histogram_t const* other)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        uint64_t count = atomic_load_explicit((atomic_uint_fast64_t*)&other->counts[i], memory_order_relaxed);
+        if (count != 0)
+        {
+            atomic_fetch_add_explicit(&histogram->counts[i], count, memory_order_relaxed);
+        }
+    }
+    raise_max(histogram, histogram_max(other));
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_snapshot
+
+    Prototype:	void histogram_snapshot(histogram_t const* histogram, histogram_t* out)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram to copy.
+    out - set to the copy.
+
+    Return Values:
+
+    Description:
+    Copies each bucket. Values recorded during the copy may or may not be included, but
+    every bucket is read whole.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void histogram_snapshot(histogram_t const* histogram, histogram_t* out)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        uint64_t count = atomic_load_explicit((atomic_uint_fast64_t*)&histogram->counts[i], memory_order_relaxed);
+        atomic_store_explicit(&out->counts[i], count, memory_order_relaxed);
+    }
+    atomic_store_explicit(&out->max, histogram_max(histogram), memory_order_relaxed);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_subtract
+
+    Prototype:	void histogram_subtract(histogram_t* histogram, histogram_t const* earlier)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - a snapshot.
+    earlier - an earlier snapshot of the same histogram.
+
+    Return Values:
+
+    Description:
+    Subtracts the earlier snapshot bucket by bucket.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void histogram_subtract(histogram_t* histogram, histogram_t const* earlier)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        uint64_t before = atomic_load_explicit((atomic_uint_fast64_t*)&earlier->counts[i], memory_order_relaxed);
+        atomic_fetch_sub_explicit(&histogram->counts[i], before, memory_order_relaxed);
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_count
+
+    Prototype:	uint64_t histogram_count(histogram_t const* histogram)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+
+    Return Values:
+    The number of values recorded.
+
+    Description:
+    Sums the buckets.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t histogram_count(histogram_t const* histogram)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        total += atomic_load_explicit((atomic_uint_fast64_t*)&histogram->counts[i], memory_order_relaxed);
+    }
+    return total;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_percentile
+
+    Prototype:	uint64_t histogram_percentile(histogram_t const* histogram, double percentile)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+    percentile - the percentile, from 0 to 100.
+
+    Return Values:
+    The largest value in the bucket holding the percentile, or 0 if nothing was recorded.
+
+    Description:
+    Walks the buckets from the bottom until they account for the requested share of the
+    values.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t histogram_percentile(histogram_t const* histogram, double percentile)
+{
+    uint64_t total = histogram_count(histogram);
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t wanted = (uint64_t)ceil(percentile / 100.0 * (double)total);
+    if (wanted == 0)
+    {
+        wanted = 1;
+    }
+    else if (wanted > total)
+    {
+        wanted = total;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += atomic_load_explicit((atomic_uint_fast64_t*)&histogram->counts[i], memory_order_relaxed);
+        if (seen >= wanted)
+        {
+            // The bucket's upper end can lie beyond anything actually recorded
+            uint64_t high = bucket_high(i);
+            uint64_t max = histogram_max(histogram);
+            return high < max ? high : max;
+        }
+    }
+    return histogram_max(histogram);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_count_below
+
+    Prototype:	uint64_t histogram_count_below(histogram_t const* histogram, uint64_t value)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+    value - the value to count up to.
+
+    Return Values:
+    The number of values in the buckets below the value's.
+
+    Description:
+    Sums the buckets below the one the value falls in.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t histogram_count_below(histogram_t const* histogram, uint64_t value)
+{
+    size_t end = bucket_index(value);
+    uint64_t total = 0;
+    for (size_t i = 0; i < end; ++i)
+    {
+        total += atomic_load_explicit((atomic_uint_fast64_t*)&histogram->counts[i], memory_order_relaxed);
+    }
+    return total;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_sum
+
+    Prototype:	double histogram_sum(histogram_t const* histogram)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+
+    Return Values:
+    The estimated sum of the values.
+
+    Description:
+    Adds up each bucket's midpoint times its count. The values themselves aren't kept, so
+    the sum is out by at most half a bucket per value.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+double histogram_sum(histogram_t const* histogram)
+{
+    double total = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        uint64_t count = atomic_load_explicit((atomic_uint_fast64_t*)&histogram->counts[i], memory_order_relaxed);
+        if (count != 0)
+        {
+            total += ((double)bucket_low(i) + (double)bucket_high(i)) / 2 * (double)count;
+        }
+    }
+    return total;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_max
+
+    Prototype:	uint64_t histogram_max(histogram_t const* histogram)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+
+    Return Values:
+    The largest value recorded, or 0 if nothing was.
+
+    Description:
+    Reads the maximum kept alongside the buckets.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t histogram_max(histogram_t const* histogram)
+{
+    return atomic_load_explicit((atomic_uint_fast64_t*)&histogram->max, memory_order_relaxed);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_print
+
+    Prototype:	void histogram_print(histogram_t const* histogram, FILE* out, char const* name,
+                                     char const* unit)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+    out - where to print.
+    name - what the values are.
+    unit - the values' unit.
+
+    Return Values:
+
+    Description:
+    Prints the count, p50, p90, p99, p99.9 and maximum on one line.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void histogram_print(histogram_t const* histogram, FILE* out, char const* name, char const* unit)
+{
+    uint64_t count = histogram_count(histogram);
+    if (count == 0)
+    {
+        fprintf(out, "%s: no values\n", name);
+        return;
+    }
+
+    fprintf(out, "%s: %" PRIu64 " values; p50 %" PRIu64 "%s, p90 %" PRIu64 "%s, p99 %" PRIu64 "%s, "
+                 "p99.9 %" PRIu64 "%s, max %" PRIu64 "%s\n", name, count,
+            histogram_percentile(histogram, 50.0), unit, histogram_percentile(histogram, 90.0), unit,
+            histogram_percentile(histogram, 99.0), unit, histogram_percentile(histogram, 99.9), unit,
+            histogram_max(histogram), unit);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_write
+
+    Prototype:	int histogram_write(histogram_t const* histogram, char const* name)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram.
+    name - the name of the file.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Writes the header, the maximum and a line for each bucket in use.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int histogram_write(histogram_t const* histogram, char const* name)
+{
+    FILE* out = fopen(name, "w");
+    if (out == NULL)
+    {
+        perror(name);
+        return -1;
+    }
+
+    fprintf(out, "%s\nmax %" PRIu64 "\n", HISTOGRAM_FILE_MAGIC, histogram_max(histogram));
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        uint64_t count = atomic_load_explicit((atomic_uint_fast64_t*)&histogram->counts[i], memory_order_relaxed);
+        if (count != 0)
+        {
+            fprintf(out, "%" PRIu64 " %" PRIu64 "\n", bucket_low(i), count);
+        }
+    }
+
+    int result = 0;
+    if (ferror(out))
+    {
+        perror(name);
+        result = -1;
+    }
+    if (fclose(out) == EOF && result == 0)
+    {
+        perror(name);
+        result = -1;
+    }
+    return result;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		histogram_read
+
+    Prototype:	int histogram_read(histogram_t* histogram, char const* name)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    histogram - the histogram to add to.
+    name - the name of the file.
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Reads the whole file into a scratch histogram first so that a bad file doesn't leave
+    half of its counts behind, then adds that to the given histogram. Each line's value is
+    re-bucketed, so files only have to agree on the format, not on the bucket layout.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int histogram_read(histogram_t* histogram, char const* name)
+{
+    FILE* in = fopen(name, "r");
+    if (in == NULL)
+    {
+        perror(name);
+        return -1;
+    }
+
+    histogram_t* scratch = calloc(1, sizeof(histogram_t));
+    if (scratch == NULL)
+    {
+        perror("calloc");
+        fclose(in);
+        return -1;
+    }
+
+    int result = 0;
+    char magic[32];
+    uint64_t max;
+    if (fgets(magic, sizeof(magic), in) == NULL || strcmp(magic, HISTOGRAM_FILE_MAGIC "\n") != 0 ||
+        fscanf(in, "max %" SCNu64, &max) != 1)
+    {
+        fprintf(stderr, "%s: not a saved histogram\n", name);
+        result = -1;
+    }
+    else
+    {
+        atomic_store_explicit(&scratch->max, max, memory_order_relaxed);
+
+        uint64_t value, count;
+        int num_read;
+        while ((num_read = fscanf(in, "%" SCNu64 " %" SCNu64, &value, &count)) == 2)
+        {
+            atomic_fetch_add_explicit(&scratch->counts[bucket_index(value)], count, memory_order_relaxed);
+        }
+        if (num_read != EOF || ferror(in))
+        {
+            fprintf(stderr, "%s: bad bucket line\n", name);
+            result = -1;
+        }
+    }
+
+    if (result == 0)
+    {
+        histogram_add(histogram, scratch);
+    }
+    free(scratch);
+    fclose(in);
+    return result;
+}
@@ -1,70 +1,230 @@
 #include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "futex.h"
 #include "ring_buffer.h"
 
-void ring_buffer_init(ring_buffer_t* buf, void* mem, size_t size, size_t elem_size)
+// How many failed tries the blocking calls make before sleeping
+#define RING_BUFFER_SPIN 128
+
+// Each slot is its sequence number followed by the element, padded so that sequences stay aligned
+typedef struct
+{
+    atomic_size_t seq;
+} ring_buffer_slot;
+
+static ring_buffer_slot* slot_at(ring_buffer_t* buf, size_t pos)
 {
-    buf->mem = mem;
-    buf->size = size;
+    return (ring_buffer_slot*)(buf->slots + (pos & buf->mask) * buf->slot_size);
+}
+
+int ring_buffer_init(ring_buffer_t* buf, size_t size, size_t elem_size)
+{
+    // With a single slot, the sequence that marks it written for one position would also mark it free for
+    // the next
+    size_t capacity = 2;
+    while (capacity < size)
+    {
+        capacity <<= 1;
+    }
+
+    size_t const align = _Alignof(max_align_t);
+    buf->slot_size = (sizeof(ring_buffer_slot) + elem_size + align - 1) / align * align;
+    buf->slots = malloc(capacity * buf->slot_size);
+    if (!buf->slots)
+    {
+        return -1;
+    }
+
     buf->elem_size = elem_size;
-    buf->head = 0;
-    buf->tail = 0;
-    buf->reader_guard = 0;
+    buf->mask = capacity - 1;
+    buf->size = capacity;
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        atomic_init(&slot_at(buf, i)->seq, i);
+    }
+    atomic_init(&buf->head, 0);
+    atomic_init(&buf->tail, 0);
+    atomic_init(&buf->put_event, 0);
+    atomic_init(&buf->get_waiters, 0);
+    atomic_init(&buf->get_event, 0);
+    atomic_init(&buf->put_waiters, 0);
+    return 0;
+}
+
+void ring_buffer_free(ring_buffer_t* buf)
+{
+    free(buf->slots);
+    buf->slots = NULL;
 }
 
-void ring_buffer_put(ring_buffer_t* buf, void* item)
+/**
+ * Wakes one sleeper on the other side, if there is one. The fence orders the slot's sequence store before
+ * the waiter count load, against the sleeper incrementing the count before it tries once more, so that
+ * one of the two always sees the other.
+ */
+static void wake_one(atomic_int* event, atomic_int* waiters)
 {
-    int wrote = 0;
-    do
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiters, memory_order_relaxed) > 0)
     {
-        size_t head = atomic_load(&buf->head);
-        size_t tail = atomic_load(&buf->tail);
-        size_t diff = tail - head; // This will eventually wrap around, but we're unlikely to hit that case ¯\_(ツ)_/¯
+        atomic_fetch_add(event, 1);
+        futex_wake(event, 1);
+    }
+}
 
-        if (diff < buf->size &&
-            atomic_compare_exchange_strong(&buf->tail, &tail, tail + 1))
+static int try_put(ring_buffer_t* buf, void const* item)
+{
+    size_t pos = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+    ring_buffer_slot* slot;
+    while (1)
+    {
+        slot = slot_at(buf, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
         {
-            // There was space for another element in the buffer and we successfully added to tail,
-            // so we can safely write to the buffer... probably
-            size_t pos = (tail % buf->size) * buf->elem_size;
-            unsigned char* dest = (unsigned char*)buf->mem + pos;
-            memcpy(dest, item, buf->elem_size);
-
-            wrote = 1;
-            atomic_store_explicit(&buf->reader_guard, 1, memory_order_release);
+            // The slot is free for this position; claim it
+            if (atomic_compare_exchange_weak_explicit(&buf->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Still holds the item from a lap ago
+            return -1;
         }
-    } while (!wrote);
+        else
+        {
+            pos = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot + 1, item, buf->elem_size);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 0;
 }
 
-void ring_buffer_get(ring_buffer_t* buf, void* out)
+static int try_get(ring_buffer_t* buf, void* out)
 {
-    int read = 0;
-    do
+    size_t pos = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    ring_buffer_slot* slot;
+    while (1)
     {
-        // TODO: Do we actually need memory_order_acquire for head? Only one thread ever modifies it (or should, at least)
-        size_t head = atomic_load(&buf->head);
-        size_t tail = atomic_load(&buf->tail);
-
-        // There's no data to read - set the reader guard to 0 so that we'll block until some other thread writes
-        if (head == tail)
+        slot = slot_at(buf, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
         {
-            atomic_store(&buf->reader_guard, 0); // Not sure if this needs to be sequentially consistent
-            break;
+            // The slot has been written for this position; claim it
+            if (atomic_compare_exchange_weak_explicit(&buf->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Not written yet (or not even claimed)
+            return -1;
         }
         else
         {
-            // Also not sure if this needs to be sequentially consistent (provided that the store to reader_guard is
-            int reader_guard = atomic_load_explicit(&buf->reader_guard, memory_order_acquire);
-            if (reader_guard)
-            {
-                unsigned char* mem = (unsigned char*)buf->mem;
-                size_t pos = (head % buf->size) * buf->elem_size;
-                memcpy(out, mem + pos, buf->elem_size);
+            pos = atomic_load_explicit(&buf->head, memory_order_relaxed);
+        }
+    }
 
-                atomic_store_explicit(&buf->head, head + 1, memory_order_release);
-                read = 1;
-            }
+    memcpy(out, slot + 1, buf->elem_size);
+    atomic_store_explicit(&slot->seq, pos + buf->size, memory_order_release);
+    return 0;
+}
+
+int ring_buffer_try_put(ring_buffer_t* buf, void const* item)
+{
+    if (try_put(buf, item) == -1)
+    {
+        return -1;
+    }
+    wake_one(&buf->get_event, &buf->get_waiters);
+    return 0;
+}
+
+int ring_buffer_try_get(ring_buffer_t* buf, void* out)
+{
+    if (try_get(buf, out) == -1)
+    {
+        return -1;
+    }
+    wake_one(&buf->put_event, &buf->put_waiters);
+    return 0;
+}
+
+void ring_buffer_put(ring_buffer_t* buf, void const* item)
+{
+    for (unsigned int i = 0; i < RING_BUFFER_SPIN; ++i)
+    {
+        if (ring_buffer_try_put(buf, item) == 0)
+        {
+            return;
+        }
+        futex_cpu_relax();
+    }
+
+    while (1)
+    {
+        // Read the event before the last try, so that a get in between changes it and the wait falls through
+        int event = atomic_load(&buf->put_event);
+        atomic_fetch_add(&buf->put_waiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        int result = ring_buffer_try_put(buf, item);
+        if (result == -1)
+        {
+            futex_wait(&buf->put_event, event);
+        }
+        atomic_fetch_sub(&buf->put_waiters, 1);
+        if (result == 0)
+        {
+            return;
         }
-    } while(!read);
-}
\ No newline at end of file
+    }
+}
+
+void ring_buffer_get(ring_buffer_t* buf, void* out)
+{
+    for (unsigned int i = 0; i < RING_BUFFER_SPIN; ++i)
+    {
+        if (ring_buffer_try_get(buf, out) == 0)
+        {
+            return;
+        }
+        futex_cpu_relax();
+    }
+
+    while (1)
+    {
+        int event = atomic_load(&buf->get_event);
+        atomic_fetch_add(&buf->get_waiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        int result = ring_buffer_try_get(buf, out);
+        if (result == -1)
+        {
+            futex_wait(&buf->get_event, event);
+        }
+        atomic_fetch_sub(&buf->get_waiters, 1);
+        if (result == 0)
+        {
+            return;
+        }
+    }
+}
+
+size_t ring_buffer_count(ring_buffer_t* buf)
+{
+    // Head first, so that a get between the loads can't make the count negative
+    size_t head = atomic_load(&buf->head);
+    return atomic_load(&buf->tail) - head;
+}
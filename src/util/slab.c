@@ -0,0 +1,362 @@
+/*********************************************************************************************
+Name:			slab.c
+
+    Required:	slab.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Slab allocator for records split into hot and cold parts. A chunk starts with a
+    cache line of header, then per_chunk hot parts, then per_chunk cold parts; record i's
+    cold part is at the same index in the second array.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+#define CHUNK_HEADER_SIZE 64 // Keeps the first hot part on its own cache line
+
+struct slab_chunk
+{
+    slab_chunk* next;
+};
+
+static slab_chunk* chunk_of(void const* hot)
+{
+    return (slab_chunk*)((uintptr_t)hot & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1));
+}
+
+/**
+ * Allocates a chunk and puts all of its records on the free list. Called with the lock held.
+ *
+ * @return 0 on success, or -1 if out of memory.
+ */
+static int add_chunk(slab_t* slab)
+{
+    slab_chunk* chunk = aligned_alloc(SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE);
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    ++slab->num_chunks;
+
+    // Pushed in reverse so that records are handed out in address order
+    char* hot = (char*)chunk + CHUNK_HEADER_SIZE;
+    for (size_t i = slab->per_chunk; i-- > 0;)
+    {
+        void* record = hot + i * slab->hot_size;
+        *(void**)record = slab->free_list;
+        slab->free_list = record;
+    }
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_init
+
+    Prototype:	int slab_init(slab_t* slab, size_t hot_size, size_t cold_size)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slab - the slab.
+    hot_size - the size of each record's hot part.
+    cold_size - the size of each record's cold part, or 0.
+
+    Return Values:
+    0 on success, or -1 if the records are too big.
+
+    Description:
+    Works out the chunk layout. No memory is allocated until the first record is.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int slab_init(slab_t* slab, size_t hot_size, size_t cold_size)
+{
+    memset(slab, 0, sizeof(*slab));
+    if (hot_size < sizeof(void*))
+    {
+        hot_size = sizeof(void*);
+    }
+
+    slab->hot_size = hot_size;
+    slab->cold_size = cold_size;
+    slab->per_chunk = (SLAB_CHUNK_SIZE - CHUNK_HEADER_SIZE) / (hot_size + cold_size);
+    slab->cold_offset = CHUNK_HEADER_SIZE + slab->per_chunk * hot_size;
+    if (slab->per_chunk == 0)
+    {
+        return -1;
+    }
+
+    pthread_mutex_init(&slab->lock, NULL);
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_alloc
+
+    Prototype:	void* slab_alloc(slab_t* slab)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slab - the slab.
+
+    Return Values:
+    The new record's hot part, or NULL if out of memory.
+
+    Description:
+    Pops a free record, adding a chunk if there are none, and zeroes both of its parts
+    outside the lock.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void* slab_alloc(slab_t* slab)
+{
+    pthread_mutex_lock(&slab->lock);
+    if (slab->free_list == NULL && add_chunk(slab) == -1)
+    {
+        pthread_mutex_unlock(&slab->lock);
+        return NULL;
+    }
+
+    void* hot = slab->free_list;
+    slab->free_list = *(void**)hot;
+    if (++slab->in_use > slab->peak)
+    {
+        slab->peak = slab->in_use;
+    }
+    pthread_mutex_unlock(&slab->lock);
+
+    memset(hot, 0, slab->hot_size);
+    if (slab->cold_size > 0)
+    {
+        memset(slab_cold(slab, hot), 0, slab->cold_size);
+    }
+    return hot;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_cold
+
+    Prototype:	void* slab_cold(slab_t const* slab, void const* hot)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slab - the slab the record came from.
+    hot - the record's hot part.
+
+    Return Values:
+    The record's cold part.
+
+    Description:
+    The chunk is found by rounding the address down to the chunk size, and the record's
+    index from its offset in the chunk.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void* slab_cold(slab_t const* slab, void const* hot)
+{
+    char* chunk = (char*)chunk_of(hot);
+    size_t index = (size_t)((char const*)hot - chunk - CHUNK_HEADER_SIZE) / slab->hot_size;
+    return chunk + slab->cold_offset + index * slab->cold_size;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_free
+
+    Prototype:	void slab_free(slab_t* slab, void* hot)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slab - the slab the record came from.
+    hot - the record's hot part, or NULL.
+
+    Return Values:
+
+    Description:
+    Pushes the record onto the free list, so the next allocation reuses it while it's
+    likely still in the cache.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void slab_free(slab_t* slab, void* hot)
+{
+    if (hot == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&slab->lock);
+    *(void**)hot = slab->free_list;
+    slab->free_list = hot;
+    --slab->in_use;
+    pthread_mutex_unlock(&slab->lock);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_destroy
+
+    Prototype:	void slab_destroy(slab_t* slab)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slab - the slab.
+
+    Return Values:
+
+    Description:
+    Frees every chunk and leaves the slab empty.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void slab_destroy(slab_t* slab)
+{
+    slab_chunk* chunk = slab->chunks;
+    while (chunk != NULL)
+    {
+        slab_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    slab->chunks = NULL;
+    slab->free_list = NULL;
+    slab->in_use = 0;
+    slab->num_chunks = 0;
+    pthread_mutex_destroy(&slab->lock);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_record_bytes
+
+    Prototype:	size_t slab_record_bytes(slab_t const* slab)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slab - the slab.
+
+    Return Values:
+    The chunk size divided by the records per chunk, rounded up.
+
+    Description:
+    Includes the chunk header and whatever is left over at the end of each chunk.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+size_t slab_record_bytes(slab_t const* slab)
+{
+    return (SLAB_CHUNK_SIZE + slab->per_chunk - 1) / slab->per_chunk;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		slab_print
+
+    Prototype:	void slab_print(slab_t* const* slabs, size_t num_slabs, FILE* out,
+                                char const* name, size_t extra_bytes)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    slabs - the slabs, which all have the same record layout.
+    num_slabs - the number of slabs.
+    out - where to print.
+    name - what the records are.
+    extra_bytes - memory per record kept outside the slabs.
+
+    Return Values:
+
+    Description:
+    Prints e.g. "Connections: 136 bytes each (64 hot, 64 cold, 0 chunk overhead, 8 lookup);
+    130 MB per million", followed by the peak across all of the slabs if there is one. The
+    peaks of several slabs are added together, so with more than one slab they're an upper
+    bound.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void slab_print(slab_t* const* slabs, size_t num_slabs, FILE* out, char const* name, size_t extra_bytes)
+{
+    if (num_slabs == 0)
+    {
+        return;
+    }
+
+    slab_t const* first = slabs[0];
+    size_t record_bytes = slab_record_bytes(first);
+    size_t total = record_bytes + extra_bytes;
+    fprintf(out, "%s: %zu bytes each (%zu hot, %zu cold, %zu chunk overhead, %zu lookup); %.0f MB per million",
+            name, total, first->hot_size, first->cold_size, record_bytes - first->hot_size - first->cold_size,
+            extra_bytes, total * 1e6 / (1024 * 1024));
+
+    size_t peak = 0;
+    size_t chunks = 0;
+    for (size_t i = 0; i < num_slabs; ++i)
+    {
+        pthread_mutex_lock(&slabs[i]->lock);
+        peak += slabs[i]->peak;
+        chunks += slabs[i]->num_chunks;
+        pthread_mutex_unlock(&slabs[i]->lock);
+    }
+    if (peak > 0)
+    {
+        fprintf(out, "; peak %zu in %zu chunks (%zu KB)", peak, chunks, chunks * SLAB_CHUNK_SIZE / 1024);
+    }
+    fprintf(out, "\n");
+}
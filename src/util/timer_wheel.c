@@ -0,0 +1,391 @@
+/*********************************************************************************************
+Name:			timer_wheel.c
+
+    Required:	timer_wheel.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Hierarchical timer wheel. Each level keeps a bitmap of its non-empty slots, which is
+    what lets the wheel skip empty stretches of ticks and find its next deadline without
+    looking at any timers.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define MAX_DELTA (((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1) // Ticks
+
+static uint64_t rotate_right(uint64_t bits, unsigned int count)
+{
+    count &= 63;
+    return count == 0 ? bits : (bits >> count) | (bits << (64 - count));
+}
+
+/**
+ * Links a timer into the slot for its expiry, relative to the wheel's current tick.
+ */
+static void place(timer_wheel_t* wheel, timer_entry* entry)
+{
+    if (entry->expires < wheel->now)
+    {
+        entry->expires = wheel->now;
+    }
+    uint64_t delta = entry->expires - wheel->now;
+    if (delta > MAX_DELTA)
+    {
+        entry->expires = wheel->now + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+
+    unsigned int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1)))
+    {
+        ++level;
+    }
+    unsigned int slot = (unsigned int)(entry->expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK;
+
+    timer_entry** head = &wheel->slots[level][slot];
+    entry->next = *head;
+    if (entry->next != NULL)
+    {
+        entry->next->pprev = &entry->next;
+    }
+    *head = entry;
+    entry->pprev = head;
+    entry->level = (uint8_t)level;
+    entry->slot = (uint8_t)slot;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+/**
+ * Moves the timers in a level's current slot down to the levels below, now that they're in range.
+ */
+static void cascade(timer_wheel_t* wheel, unsigned int level)
+{
+    unsigned int slot = (unsigned int)(wheel->now >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK;
+    timer_entry* entry = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+    while (entry != NULL)
+    {
+        timer_entry* next = entry->next;
+        place(wheel, entry);
+        entry = next;
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		timer_wheel_clock
+
+    Prototype:	uint64_t timer_wheel_clock(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    CLOCK_MONOTONIC in milliseconds.
+
+    Description:
+    Monotonic so that deadlines aren't thrown out by the wall clock being set.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+uint64_t timer_wheel_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		timer_wheel_init
+
+    Prototype:	void timer_wheel_init(timer_wheel_t* wheel, uint64_t now)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    wheel - the wheel.
+    now - the current time in milliseconds.
+
+    Return Values:
+
+    Description:
+    Starts the wheel at the current tick.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void timer_wheel_init(timer_wheel_t* wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now / TIMER_WHEEL_TICK_MS;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		timer_wheel_schedule
+
+    Prototype:	void timer_wheel_schedule(timer_wheel_t* wheel, timer_entry* entry, uint64_t expires)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    wheel - the wheel.
+    entry - the timer.
+    expires - the deadline in milliseconds.
+
+    Return Values:
+
+    Description:
+    The deadline is rounded up to a tick, so that the timer can't fire before it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void timer_wheel_schedule(timer_wheel_t* wheel, timer_entry* entry, uint64_t expires)
+{
+    timer_wheel_cancel(wheel, entry);
+    entry->expires = (expires + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+    place(wheel, entry);
+    ++wheel->count;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		timer_wheel_cancel
+
+    Prototype:	void timer_wheel_cancel(timer_wheel_t* wheel, timer_entry* entry)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    wheel - the wheel.
+    entry - the timer.
+
+    Return Values:
+
+    Description:
+    Unlinks the timer through its pprev pointer, which also works while the wheel is
+    running the timers of a tick it has taken out of their slot.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_entry* entry)
+{
+    if (entry->pprev == NULL)
+    {
+        return;
+    }
+
+    *entry->pprev = entry->next;
+    if (entry->next != NULL)
+    {
+        entry->next->pprev = entry->pprev;
+    }
+    if (wheel->slots[entry->level][entry->slot] == NULL)
+    {
+        wheel->occupied[entry->level] &= ~((uint64_t)1 << entry->slot);
+    }
+
+    entry->next = NULL;
+    entry->pprev = NULL;
+    --wheel->count;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		timer_wheel_timeout
+
+    Prototype:	int timer_wheel_timeout(timer_wheel_t const* wheel, uint64_t now)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    wheel - the wheel.
+    now - the current time in milliseconds.
+
+    Return Values:
+    Milliseconds until the wheel next needs advancing, or -1 if it's empty.
+
+    Description:
+    Level 0's slots are single ticks, so its first occupied slot after the current one is
+    the next expiry. A higher level's first occupied slot is only known to the nearest turn
+    of the level below, so for those it's the tick on which the slot is cascaded.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int timer_wheel_timeout(timer_wheel_t const* wheel, uint64_t now)
+{
+    if (wheel->count == 0)
+    {
+        return -1;
+    }
+
+    uint64_t next = UINT64_MAX;
+    if (wheel->occupied[0] != 0)
+    {
+        unsigned int current = (unsigned int)wheel->now & SLOT_MASK;
+        next = wheel->now + (uint64_t)__builtin_ctzll(rotate_right(wheel->occupied[0], current));
+    }
+    for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        if (wheel->occupied[level] == 0)
+        {
+            continue;
+        }
+
+        // The current slot is cascaded on the first tick of its turn; once that tick has been run, the slot
+        // isn't due again for a full turn
+        unsigned int shift = TIMER_WHEEL_BITS * level;
+        unsigned int current = (unsigned int)(wheel->now >> shift) & SLOT_MASK;
+        unsigned int first = (wheel->now & (((uint64_t)1 << shift) - 1)) == 0 ? current : current + 1;
+        uint64_t turns = (uint64_t)__builtin_ctzll(rotate_right(wheel->occupied[level], first)) + (first - current);
+        uint64_t at = ((wheel->now >> shift) + turns) << shift;
+        if (at < next)
+        {
+            next = at;
+        }
+    }
+
+    uint64_t at_ms = next * TIMER_WHEEL_TICK_MS;
+    if (at_ms <= now)
+    {
+        return 0;
+    }
+    return at_ms - now > INT_MAX ? INT_MAX : (int)(at_ms - now);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		timer_wheel_advance
+
+    Prototype:	size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now,
+                                           timer_wheel_expired expired, void* arg)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    wheel - the wheel.
+    now - the current time in milliseconds.
+    expired - called for each timer that expires.
+    arg - passed to expired.
+
+    Return Values:
+    The number of timers that expired.
+
+    Description:
+    Cascades at the start of each turn of a level, then takes the tick's slot out of the
+    wheel before running its timers, so that timers scheduled by the callback land on a
+    later tick rather than in the list being run. Stretches with nothing in level 0 are
+    skipped a turn at a time.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now, timer_wheel_expired expired, void* arg)
+{
+    uint64_t target = now / TIMER_WHEEL_TICK_MS;
+    size_t num_expired = 0;
+
+    while (wheel->now <= target)
+    {
+        if (wheel->count == 0)
+        {
+            wheel->now = target + 1;
+            break;
+        }
+
+        unsigned int slot = (unsigned int)wheel->now & SLOT_MASK;
+        if (slot == 0)
+        {
+            for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+            {
+                cascade(wheel, level);
+                if (((wheel->now >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK) != 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (wheel->occupied[0] == 0)
+        {
+            // Nothing is due before the next turn of level 0
+            uint64_t next_turn = (wheel->now | SLOT_MASK) + 1;
+            wheel->now = next_turn < target + 1 ? next_turn : target + 1;
+            continue;
+        }
+
+        timer_entry* list = wheel->slots[0][slot];
+        wheel->slots[0][slot] = NULL;
+        wheel->occupied[0] &= ~((uint64_t)1 << slot);
+        if (list != NULL)
+        {
+            list->pprev = &list;
+        }
+        ++wheel->now;
+
+        while (list != NULL)
+        {
+            timer_entry* entry = list;
+            list = entry->next;
+            if (list != NULL)
+            {
+                list->pprev = &list;
+            }
+            entry->next = NULL;
+            entry->pprev = NULL;
+            --wheel->count;
+
+            expired(entry, arg);
+            ++num_expired;
+        }
+    }
+
+    return num_expired;
+}
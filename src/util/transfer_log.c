@@ -0,0 +1,346 @@
+/*********************************************************************************************
+Name:			transfer_log.c
+
+    Required:	transfer_log.h
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Description:
+    Binary log of finished connections. The whole file is mapped up front at its maximum
+    size; each record claims its slot with a single atomic add and is written straight into
+    the mapping. The file itself is extended a chunk at a time by a thread of its own, which
+    the appenders wake once they're half way through the last chunk, so they never wait for
+    the disk; it's trimmed to the claimed records when closed.
+
+    Revisions:
+    2026-10-17 - Extend the file from its own thread, ahead of the appenders.
+
+*********************************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L // ftruncate
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "futex.h"
+#include "transfer_log.h"
+
+#define MAX_RECORDS   ((size_t)1 << 24) // 768 MB of address space; the file only grows as needed
+#define CHUNK_RECORDS ((size_t)1 << 16)
+
+static int log_fd = -1;
+static char* map;
+static size_t map_size;
+static atomic_size_t next_record;  // Next slot to claim
+static atomic_size_t backed;       // Slots the file is currently long enough to hold; only the grower raises it
+static atomic_size_t dropped;
+
+static pthread_t grower;
+static atomic_int grow_event;      // Bumped to wake the grower
+static atomic_int stopping;
+
+static off_t file_size(size_t records)
+{
+    return (off_t)(sizeof(transfer_log_header) + records * sizeof(transfer_record));
+}
+
+/**
+ * Extends the file until it covers the given number of slots. Writing to a page of the mapping past the
+ * end of the file would raise SIGBUS, so backed is only raised once the file is long enough.
+ *
+ * @param want The number of slots the file has to hold.
+ * @return 0 on success, or -1 on failure.
+ */
+static int grow(size_t want)
+{
+    if (want > MAX_RECORDS)
+    {
+        want = MAX_RECORDS;
+    }
+    if (want <= atomic_load(&backed))
+    {
+        return 0;
+    }
+    if (ftruncate(log_fd, file_size(want)) == -1)
+    {
+        perror("ftruncate");
+        return -1;
+    }
+    atomic_store_explicit(&backed, want, memory_order_release);
+    return 0;
+}
+
+/**
+ * The grower thread: keeps the file at least half a chunk ahead of the last claimed slot, sleeping until
+ * an appender gets half way through the last chunk.
+ */
+static void* grower_func(void* arg)
+{
+    (void)arg;
+    while (!atomic_load(&stopping))
+    {
+        // Read the event before looking at the claims, so that a wake in between makes the wait fall through
+        int event = atomic_load(&grow_event);
+        size_t claimed = atomic_load(&next_record);
+        size_t have = atomic_load(&backed);
+        if (have < MAX_RECORDS && claimed + CHUNK_RECORDS / 2 >= have)
+        {
+            if (grow((claimed / CHUNK_RECORDS + 2) * CHUNK_RECORDS) == -1)
+            {
+                // Later claims are dropped until the disk has room again
+                futex_wait_for(&grow_event, event, 1000);
+            }
+            continue;
+        }
+        futex_wait(&grow_event, event);
+    }
+    return NULL;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		transfer_log_open
+
+    Prototype:	int transfer_log_open(char const* name)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    name - name of the log file
+
+    Return Values:
+    0 on success, or -1 on failure (an error message is printed to stderr in this case).
+
+    Description:
+    Creates the file with its header and first chunk of slots, maps enough of it for
+    MAX_RECORDS records and starts the thread that extends it.
+
+    Revisions:
+	2026-10-17 - Start the grower thread.
+
+*********************************************************************************************/
+int transfer_log_open(char const* name)
+{
+    log_fd = open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log_fd == -1)
+    {
+        perror("open");
+        return -1;
+    }
+
+    atomic_store(&next_record, 0);
+    atomic_store(&backed, 0);
+    atomic_store(&dropped, 0);
+    atomic_store(&stopping, 0);
+    if (grow(CHUNK_RECORDS) == -1)
+    {
+        close(log_fd);
+        return -1;
+    }
+
+    map_size = (size_t)file_size(MAX_RECORDS);
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, log_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap");
+        map = NULL;
+        close(log_fd);
+        return -1;
+    }
+
+    transfer_log_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRANSFER_LOG_MAGIC, sizeof(header.magic));
+    header.version = TRANSFER_LOG_VERSION;
+    header.record_size = sizeof(transfer_record);
+    memcpy(map, &header, sizeof(header));
+
+    // The grower never handles signals; with them blocked it inherits nothing that could take the server's
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int created = pthread_create(&grower, NULL, grower_func, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (created != 0)
+    {
+        fprintf(stderr, "pthread_create failed for the transfer log\n");
+        munmap(map, map_size);
+        map = NULL;
+        close(log_fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		transfer_log_append
+
+    Prototype:	int transfer_log_append(struct timeval const* closed_at, time_t transfer_time,
+                                        ssize_t transferred, uint32_t messages,
+                                        struct sockaddr_in const* peer)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    closed_at - when the connection was closed.
+    transfer_time - microseconds spent serving the connection.
+    transferred - bytes received from the client.
+    messages - messages echoed.
+    peer - the client's address.
+
+    Return Values:
+    0 on success, or -1 if the record was dropped.
+
+    Description:
+    Claims the next slot and fills it in. Never blocks: the claim that reaches the middle of
+    a chunk wakes the grower, and a slot the file doesn't cover yet is dropped. Dropped
+    records are counted and reported on close.
+
+    Revisions:
+	2026-10-17 - Leave extending the file to the grower thread.
+
+*********************************************************************************************/
+int transfer_log_append(struct timeval const* closed_at, time_t transfer_time, ssize_t transferred,
+                        uint32_t messages, struct sockaddr_in const* peer)
+{
+    if (map == NULL)
+    {
+        return -1;
+    }
+
+    size_t slot = atomic_fetch_add_explicit(&next_record, 1, memory_order_relaxed);
+    if (slot % CHUNK_RECORDS == CHUNK_RECORDS / 2)
+    {
+        // Half a chunk left; have the next one ready before anyone gets there
+        atomic_fetch_add(&grow_event, 1);
+        futex_wake(&grow_event, 1);
+    }
+    if (slot >= atomic_load_explicit(&backed, memory_order_acquire))
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    transfer_record* record = (transfer_record*)(map + sizeof(transfer_log_header)) + slot;
+    record->closed_at = (int64_t)closed_at->tv_sec * 1000000 + closed_at->tv_usec;
+    record->transfer_time = transfer_time;
+    record->transferred = transferred;
+    record->messages = messages;
+    record->addr = peer->sin_addr.s_addr;
+    record->port = ntohs(peer->sin_port);
+    record->reserved = 0;
+    record->flags = TRANSFER_RECORD_VALID;
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		transfer_log_counts
+
+    Prototype:	void transfer_log_counts(size_t* written, size_t* lost)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+    written - set to the number of records appended.
+    lost - set to the number of records dropped.
+
+    Return Values:
+
+    Description:
+    Every append claims a slot, so the records written are the claimed slots less the
+    dropped ones. A record may still be being filled in when it's counted.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void transfer_log_counts(size_t* written, size_t* lost)
+{
+    size_t lost_now = atomic_load(&dropped);
+    size_t claimed = atomic_load(&next_record);
+    *written = claimed > lost_now ? claimed - lost_now : 0;
+    *lost = lost_now;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		transfer_log_close
+
+    Prototype:	int transfer_log_close(void)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2026-10-17
+
+    Parameters:
+
+    Return Values:
+    0 on success, or -1 on failure.
+
+    Description:
+    Stops the grower, unmaps the log, trims off the unclaimed slots at the end of the last
+    chunk and closes the file.
+
+    Revisions:
+	2026-10-17 - Stop the grower thread first.
+
+*********************************************************************************************/
+int transfer_log_close(void)
+{
+    if (map == NULL)
+    {
+        return 0;
+    }
+
+    atomic_store(&stopping, 1);
+    atomic_fetch_add(&grow_event, 1);
+    futex_wake(&grow_event, 1);
+    pthread_join(grower, NULL);
+
+    munmap(map, map_size);
+    map = NULL;
+
+    size_t used = atomic_load(&next_record);
+    size_t have = atomic_load(&backed);
+    int result = ftruncate(log_fd, file_size(used < have ? used : have));
+    if (result == -1)
+    {
+        perror("ftruncate");
+    }
+
+    size_t lost = atomic_load(&dropped);
+    if (lost > 0)
+    {
+        fprintf(stderr, "transfer log: dropped %zu records\n", lost);
+    }
+
+    if (close(log_fd) == -1)
+    {
+        result = -1;
+    }
+    log_fd = -1;
+    return result;
+}